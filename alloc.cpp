@@ -0,0 +1,73 @@
+#include "alloc.hpp"
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+static const size_t BIG_BLOCK = size_t(1) << 20;
+static const size_t HUGE_PAGE = size_t(2) << 20;
+
+AllocPolicy &allocPolicy() {
+  static AllocPolicy p;
+  return p;
+}
+
+#ifdef __linux__
+
+static size_t mapped_size(size_t bytes) {
+  return (bytes + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+}
+
+void *bigAlloc(size_t bytes) {
+  if (bytes < BIG_BLOCK) {
+    return ::operator new(bytes);
+  }
+  const AllocPolicy &policy = allocPolicy();
+  size_t len = mapped_size(bytes);
+  void *p = MAP_FAILED;
+  if (policy.hugetlb) {
+    p = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  }
+  if (p == MAP_FAILED) {
+    p = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+      throw std::bad_alloc();
+    }
+    if (policy.huge_pages || policy.hugetlb) {
+      madvise(p, len, MADV_HUGEPAGE);
+    }
+  }
+  if (policy.interleave) {
+    // MPOL_INTERLEAVE over every node; the kernel narrows the mask to the
+    // nodes we may use. Failure just leaves the default policy in place.
+    const int MPOL_INTERLEAVE_ = 3;
+    unsigned long nodes = ~0ul;
+    syscall(SYS_mbind, p, len, MPOL_INTERLEAVE_, &nodes,
+            8 * sizeof(nodes), 0);
+  }
+  return p;
+}
+
+void bigFree(void *p, size_t bytes) {
+  if (bytes < BIG_BLOCK) {
+    ::operator delete(p);
+  } else {
+    munmap(p, mapped_size(bytes));
+  }
+}
+
+#else
+
+void *bigAlloc(size_t bytes) {
+  return ::operator new(bytes);
+}
+
+void bigFree(void *p, size_t) {
+  ::operator delete(p);
+}
+
+#endif
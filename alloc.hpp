@@ -0,0 +1,49 @@
+#ifndef ALLOC_HPP
+#define ALLOC_HPP
+
+#include <cstddef>
+#include <new>
+
+// Placement of the big per-vertex and per-pair arrays. Blocks of at least
+// BIG_BLOCK bytes are mapped directly and, depending on the policy, backed
+// by huge pages and interleaved across NUMA nodes; smaller ones come from
+// operator new. Without any policy, a mapped block behaves like malloc's own
+// mmap path. Linux only; elsewhere everything goes through operator new.
+
+struct AllocPolicy {
+  bool huge_pages = false;   // transparent huge pages (madvise)
+  bool hugetlb = false;      // explicit huge pages, falling back to THP
+  bool interleave = false;   // spread pages over all NUMA nodes
+};
+
+// Set before the arrays are allocated. Without interleaving, pages land
+// on the node of the thread that first touches them, which is the worker
+// that builds its mesh in the multi-threaded modes.
+AllocPolicy &allocPolicy();
+
+void *bigAlloc(size_t bytes);
+void bigFree(void *p, size_t bytes);
+
+template <typename T>
+class BigAllocator {
+public:
+  typedef T value_type;
+
+  BigAllocator() = default;
+  template <typename U>
+  BigAllocator(const BigAllocator<U> &) {}
+
+  T *allocate(size_t n) {
+    return static_cast<T *>(bigAlloc(n * sizeof(T)));
+  }
+  void deallocate(T *p, size_t n) {
+    bigFree(p, n * sizeof(T));
+  }
+
+  template <typename U>
+  bool operator==(const BigAllocator<U> &) const { return true; }
+  template <typename U>
+  bool operator!=(const BigAllocator<U> &) const { return false; }
+};
+
+#endif
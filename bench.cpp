@@ -0,0 +1,118 @@
+#include "mesh.hpp"
+#include "alloc.hpp"
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+// Times the collapse loop on a synthetic bumpy sphere under each placement
+// policy of alloc.hpp.
+//
+// Usage: bench [rings] [ratio]
+
+static void sphere(size_t n, std::vector<Vector3f> &verts,
+                   std::vector<uint32_t> &tris) {
+  size_t m = 2 * n;
+  for (size_t i = 1; i < n; i++) {
+    real t = M_PI * i / n;
+    for (size_t j = 0; j < m; j++) {
+      real p = 2 * M_PI * j / m;
+      real r = 1 + 0.1 * std::sin(5 * t) * std::cos(3 * p);
+      verts.emplace_back(r * std::sin(t) * std::cos(p),
+                         r * std::sin(t) * std::sin(p),
+                         r * std::cos(t));
+    }
+  }
+  uint32_t top = verts.size(), bot = top + 1;
+  verts.emplace_back(0, 0, 1);
+  verts.emplace_back(0, 0, -1);
+  auto idx = [m](size_t i, size_t j) { return (i - 1) * m + j % m; };
+  auto tri = [&tris](uint32_t a, uint32_t b, uint32_t c) {
+    tris.push_back(a);
+    tris.push_back(b);
+    tris.push_back(c);
+  };
+  for (size_t i = 1; i + 1 < n; i++) {
+    for (size_t j = 0; j < m; j++) {
+      tri(idx(i, j), idx(i + 1, j), idx(i + 1, j + 1));
+      tri(idx(i, j), idx(i + 1, j + 1), idx(i, j + 1));
+    }
+  }
+  for (size_t j = 0; j < m; j++) {
+    tri(top, idx(1, j + 1), idx(1, j));
+    tri(bot, idx(n - 1, j), idx(n - 1, j + 1));
+  }
+}
+
+// kB of anonymous memory currently backed by transparent huge pages
+static long anon_huge_kb() {
+  std::ifstream in("/proc/self/smaps_rollup");
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.compare(0, 14, "AnonHugePages:") == 0) {
+      std::istringstream ls(line.substr(14));
+      long kb;
+      ls >> kb;
+      return kb;
+    }
+  }
+  return -1;
+}
+
+int main(int argc, char *argv[]) {
+  using clock = std::chrono::steady_clock;
+  size_t rings = argc > 1 ? std::stoul(argv[1]) : 500;
+  real ratio = argc > 2 ? std::stod(argv[2]) : 0.1;
+
+  std::vector<Vector3f> verts;
+  std::vector<uint32_t> tris;
+  sphere(rings, verts, tris);
+  std::cout << verts.size() << " vertices, " << tris.size() / 3
+            << " triangles, down to " << ratio << std::endl;
+
+  struct Case {
+    const char *name;
+    AllocPolicy policy;
+  } cases[] = {
+    {"default", {false, false, false}},
+    {"huge-pages", {true, false, false}},
+    {"hugetlb", {false, true, false}},
+    {"interleave", {false, false, true}},
+    {"huge+interleave", {true, false, true}},
+  };
+
+  std::cout << std::left << std::setw(18) << "policy" << std::right
+            << std::setw(10) << "init s" << std::setw(12) << "collapse s"
+            << std::setw(14) << "collapses/s" << std::setw(14) << "THP kB"
+            << std::endl;
+  for (auto &c : cases) {
+    allocPolicy() = c.policy;
+    Mesh m(verts, std::vector<uint32_t>(tris));
+    SimplifyOptions opts;
+    opts.verbose = false;
+
+    // ratio 1 is reached right after initialization
+    clock::time_point start = clock::now(), ready, done;
+    long huge_kb = 0;
+    m.simplify([&](Mesh &, real r) {
+                 if (r == 1) {
+                   huge_kb = anon_huge_kb();
+                   ready = clock::now();
+                 } else {
+                   done = clock::now();
+                 }
+               },
+               {1, ratio}, opts);
+
+    std::chrono::duration<double> init = ready - start, collapse = done - ready;
+    size_t collapses = verts.size() - static_cast<size_t>(ratio * verts.size());
+    std::cout << std::left << std::setw(18) << c.name << std::right
+              << std::setw(10) << std::setprecision(3) << init.count()
+              << std::setw(12) << collapse.count()
+              << std::setw(14) << std::setprecision(6)
+              << collapses / collapse.count()
+              << std::setw(14) << huge_kb << std::endl;
+  }
+}
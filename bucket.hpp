@@ -0,0 +1,96 @@
+#ifndef BUCKET_HPP
+#define BUCKET_HPP
+
+#include "queue.hpp"
+#include "stats.hpp"
+#include <cmath>
+#include <vector>
+
+// Approximate priority queue: pairs are bucketed by a logarithmic
+// quantization of their error (SUB buckets per power of two), so insert,
+// update and erase are O(1) and top returns some pair from the lowest
+// non-empty bucket, i.e. within about 1/SUB of the least error.
+class BucketQueue : public PairQueue {
+private:
+  static const int SUB = 8;
+  static const int EMIN = -128; // errors below 2^EMIN share bucket 0
+  static const int EMAX = 128;
+  static const size_t N = 1 + (EMAX - EMIN) * SUB;
+
+  std::vector<std::vector<Pair *>> buckets;
+  size_t lowest; // no pair lives in a bucket below this
+  size_t count;
+
+  static size_t bucket(real error) {
+    if (!(error > std::ldexp(1.0, EMIN))) {
+      return 0;
+    }
+    int e;
+    real m = std::frexp(error, &e); // m in [0.5, 1)
+    if (e >= EMAX) {
+      return N - 1;
+    }
+    size_t sub = static_cast<size_t>((m - 0.5) * 2 * SUB);
+    return 1 + static_cast<size_t>(e - EMIN) * SUB + sub;
+  }
+
+  void put(Pair *p) {
+    size_t b = bucket(p->error);
+    p->slot = b;
+    p->id = buckets[b].size();
+    buckets[b].push_back(p);
+    if (b < lowest) {
+      lowest = b;
+    }
+  }
+
+  void take(Pair *p) {
+    std::vector<Pair *> &bk = buckets[p->slot];
+    Pair *last = bk.back();
+    bk[p->id] = last;
+    last->id = p->id;
+    bk.pop_back();
+  }
+
+public:
+  BucketQueue(std::vector<Pair *> &&pts)
+    : buckets(N), lowest(N), count(pts.size()) {
+    for (auto p : pts) {
+      put(p);
+    }
+    pts.clear();
+    STAT_MAX(peak_pairs, count);
+  }
+
+  void erase(Pair *p) override {
+    take(p);
+    count -= 1;
+  }
+
+  void insert(Pair *p) override {
+    put(p);
+    count += 1;
+    STAT_MAX(peak_pairs, count);
+  }
+
+  bool empty() const override {
+    return count == 0;
+  }
+
+  Pair *top() override {
+    while (buckets[lowest].empty()) {
+      STAT_INC(bucket_scan);
+      lowest += 1;
+    }
+    return buckets[lowest].back();
+  }
+
+  void update(Pair *p) override {
+    if (bucket(p->error) != p->slot) {
+      take(p);
+      put(p);
+    }
+  }
+};
+
+#endif
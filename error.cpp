@@ -0,0 +1,231 @@
+#include "error.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+
+static const uint32_t LEAF_SIZE = 4;
+// samples drawn from one generator, so results do not depend on the
+// number of threads
+static const size_t SAMPLE_BLOCK = 1024;
+
+static Vector3f vmin(const Vector3f &a, const Vector3f &b) {
+  return Vector3f(std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z));
+}
+
+static Vector3f vmax(const Vector3f &a, const Vector3f &b) {
+  return Vector3f(std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z));
+}
+
+static real box_distance2(const Vector3f &p, const Vector3f &lo, const Vector3f &hi) {
+  real dx = std::max({lo.x - p.x, real(0), p.x - hi.x});
+  real dy = std::max({lo.y - p.y, real(0), p.y - hi.y});
+  real dz = std::max({lo.z - p.z, real(0), p.z - hi.z});
+  return dx*dx + dy*dy + dz*dz;
+}
+
+static real length2(const Vector3f &v) {
+  return dot(v, v);
+}
+
+// Ericson, Real-Time Collision Detection, 5.1.5
+static Vector3f closest_on_triangle(const Vector3f &p, const Vector3f &a,
+                                    const Vector3f &b, const Vector3f &c) {
+  Vector3f ab = b - a, ac = c - a, ap = p - a;
+  real d1 = dot(ab, ap), d2 = dot(ac, ap);
+  if (d1 <= 0 && d2 <= 0) {
+    return a;
+  }
+  Vector3f bp = p - b;
+  real d3 = dot(ab, bp), d4 = dot(ac, bp);
+  if (d3 >= 0 && d4 <= d3) {
+    return b;
+  }
+  real vc = d1*d4 - d3*d2;
+  if (vc <= 0 && d1 >= 0 && d3 <= 0) {
+    return a + ab * (d1 / (d1 - d3));
+  }
+  Vector3f cp = p - c;
+  real d5 = dot(ab, cp), d6 = dot(ac, cp);
+  if (d6 >= 0 && d5 <= d6) {
+    return c;
+  }
+  real vb = d5*d2 - d1*d6;
+  if (vb <= 0 && d2 >= 0 && d6 <= 0) {
+    return a + ac * (d2 / (d2 - d6));
+  }
+  real va = d3*d6 - d5*d4;
+  if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0) {
+    return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+  }
+  real denom = va + vb + vc;
+  if (denom == 0) { // degenerate triangle
+    return a;
+  }
+  return a + ab * (vb / denom) + ac * (vc / denom);
+}
+
+TriangleBVH::TriangleBVH(const std::vector<Vector3f> &verts,
+                         const std::vector<uint32_t> &tris)
+  : verts(verts), tris(tris), order(tris.size() / 3) {
+  std::vector<Vector3f> centroids(order.size());
+  for (uint32_t t = 0; t < order.size(); t++) {
+    order[t] = t;
+    centroids[t] = (verts[tris[3*t]] + verts[tris[3*t + 1]] + verts[tris[3*t + 2]]) / 3;
+  }
+  if (!order.empty()) {
+    nodes.reserve(2 * order.size() / LEAF_SIZE + 1);
+    build(0, order.size(), centroids);
+  }
+}
+
+uint32_t TriangleBVH::build(uint32_t first, uint32_t count,
+                            std::vector<Vector3f> &centroids) {
+  uint32_t id = nodes.size();
+  nodes.emplace_back();
+  Vector3f lo = verts[tris[3 * order[first]]], hi = lo;
+  Vector3f clo = centroids[order[first]], chi = clo;
+  for (uint32_t i = first; i < first + count; i++) {
+    uint32_t t = order[i];
+    for (int j = 0; j < 3; j++) {
+      lo = vmin(lo, verts[tris[3*t + j]]);
+      hi = vmax(hi, verts[tris[3*t + j]]);
+    }
+    clo = vmin(clo, centroids[t]);
+    chi = vmax(chi, centroids[t]);
+  }
+  nodes[id].lo = lo;
+  nodes[id].hi = hi;
+
+  if (count <= LEAF_SIZE) {
+    nodes[id].first = first;
+    nodes[id].count = count;
+    return id;
+  }
+  // median split on the widest axis of the centroids
+  Vector3f ext = chi - clo;
+  int axis = ext.x >= ext.y ? (ext.x >= ext.z ? 0 : 2) : (ext.y >= ext.z ? 1 : 2);
+  auto key = [&centroids, axis](uint32_t t) {
+    return axis == 0 ? centroids[t].x : axis == 1 ? centroids[t].y : centroids[t].z;
+  };
+  uint32_t half = count / 2;
+  std::nth_element(order.begin() + first, order.begin() + first + half,
+                   order.begin() + first + count,
+                   [&key](uint32_t a, uint32_t b) { return key(a) < key(b); });
+  nodes[id].count = 0;
+  build(first, half, centroids);
+  uint32_t right = build(first + half, count - half, centroids);
+  nodes[id].right = right;
+  return id;
+}
+
+real TriangleBVH::distance(const Vector3f &p) const {
+  real best = std::numeric_limits<real>::infinity();
+  if (nodes.empty()) {
+    return best;
+  }
+  uint32_t stack[64];
+  int top = 0;
+  stack[top++] = 0;
+  while (top > 0) {
+    const Node &n = nodes[stack[--top]];
+    if (box_distance2(p, n.lo, n.hi) >= best) {
+      continue;
+    }
+    if (n.count > 0) {
+      for (uint32_t i = n.first; i < n.first + n.count; i++) {
+        uint32_t t = order[i];
+        Vector3f q = closest_on_triangle(p, verts[tris[3*t]],
+                                         verts[tris[3*t + 1]], verts[tris[3*t + 2]]);
+        best = std::min(best, length2(p - q));
+      }
+    } else {
+      // visit the nearer child first
+      uint32_t l = &n - nodes.data() + 1, r = n.right;
+      real dl = box_distance2(p, nodes[l].lo, nodes[l].hi);
+      real dr = box_distance2(p, nodes[r].lo, nodes[r].hi);
+      if (dl < dr) {
+        stack[top++] = r;
+        stack[top++] = l;
+      } else {
+        stack[top++] = l;
+        stack[top++] = r;
+      }
+    }
+  }
+  return std::sqrt(best);
+}
+
+std::vector<Vector3f> sampleSurface(const std::vector<Vector3f> &verts,
+                                    const std::vector<uint32_t> &tris,
+                                    size_t n) {
+  size_t n_tris = tris.size() / 3;
+  std::vector<real> area(n_tris + 1, 0); // running sum
+  for (size_t t = 0; t < n_tris; t++) {
+    const Vector3f &a = verts[tris[3*t]];
+    Vector3f c = cross(verts[tris[3*t + 1]] - a, verts[tris[3*t + 2]] - a);
+    area[t + 1] = area[t] + std::sqrt(length2(c)) / 2;
+  }
+  std::vector<Vector3f> samples;
+  if (n_tris == 0 || !(area.back() > 0)) {
+    return samples;
+  }
+  samples.resize(n);
+  size_t blocks = (n + SAMPLE_BLOCK - 1) / SAMPLE_BLOCK;
+  parallelFor(blocks, [&](size_t b) {
+    std::mt19937_64 rng(b);
+    std::uniform_real_distribution<real> u(0, 1);
+    for (size_t i = b * SAMPLE_BLOCK; i < std::min(n, (b + 1) * SAMPLE_BLOCK); i++) {
+      real x = u(rng) * area.back();
+      size_t t = std::upper_bound(area.begin() + 1, area.end(), x) - area.begin() - 1;
+      t = std::min(t, n_tris - 1);
+      real s = std::sqrt(u(rng)), r = u(rng);
+      const Vector3f &a = verts[tris[3*t]], &b = verts[tris[3*t + 1]], &c = verts[tris[3*t + 2]];
+      samples[i] = a * (1 - s) + b * (s * (1 - r)) + c * (s * r);
+    }
+  });
+  return samples;
+}
+
+static ErrorStats distances(const std::vector<Vector3f> &samples,
+                            const TriangleBVH &target) {
+  ErrorStats e;
+  if (samples.empty()) {
+    return e;
+  }
+  size_t blocks = (samples.size() + SAMPLE_BLOCK - 1) / SAMPLE_BLOCK;
+  std::vector<ErrorStats> partial(blocks); // max, sum, sum of squares
+  parallelFor(blocks, [&](size_t b) {
+    ErrorStats &p = partial[b];
+    for (size_t i = b * SAMPLE_BLOCK;
+         i < std::min(samples.size(), (b + 1) * SAMPLE_BLOCK); i++) {
+      real d = target.distance(samples[i]);
+      p.max = std::max(p.max, d);
+      p.mean += d;
+      p.rms += d * d;
+    }
+  });
+  for (auto &p : partial) {
+    e.max = std::max(e.max, p.max);
+    e.mean += p.mean;
+    e.rms += p.rms;
+  }
+  e.mean /= samples.size();
+  e.rms = std::sqrt(e.rms / samples.size());
+  return e;
+}
+
+ErrorMeter::ErrorMeter(std::vector<Vector3f> verts_, std::vector<uint32_t> tris_,
+                       size_t n_samples)
+  : verts(std::move(verts_)), tris(std::move(tris_)),
+    samples(sampleSurface(verts, tris, n_samples)),
+    bvh(verts, tris), n_samples(n_samples) {}
+
+void ErrorMeter::measure(const std::vector<Vector3f> &lod_verts,
+                         const std::vector<uint32_t> &lod_tris,
+                         ErrorStats &forward, ErrorStats &backward) const {
+  TriangleBVH lod(lod_verts, lod_tris);
+  forward = distances(samples, lod);
+  backward = distances(sampleSurface(lod_verts, lod_tris, n_samples), bvh);
+}
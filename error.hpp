@@ -0,0 +1,60 @@
+#ifndef ERROR_HPP
+#define ERROR_HPP
+
+#include "math.hpp"
+#include <cstdint>
+#include <vector>
+
+// Approximation error of a LOD, measured as the distance from points
+// sampled on one surface to the nearest point of the other, in both
+// directions. The max over both directions estimates the Hausdorff
+// distance.
+
+struct ErrorStats {
+  real max = 0;
+  real mean = 0;
+  real rms = 0;
+};
+
+// bounding volume hierarchy over the triangles of a mesh
+class TriangleBVH {
+  struct Node {
+    Vector3f lo, hi;
+    uint32_t first, count; // triangle range for leaves, count == 0 otherwise
+    uint32_t right;        // the left child follows its parent
+  };
+  const std::vector<Vector3f> &verts;
+  const std::vector<uint32_t> &tris;
+  std::vector<uint32_t> order; // triangle numbers, grouped by leaf
+  std::vector<Node> nodes;
+
+  uint32_t build(uint32_t first, uint32_t count, std::vector<Vector3f> &centroids);
+public:
+  // keeps references to verts and tris
+  TriangleBVH(const std::vector<Vector3f> &verts, const std::vector<uint32_t> &tris);
+  // distance to the nearest point of the surface
+  real distance(const Vector3f &p) const;
+};
+
+// Area-uniform samples on a triangle mesh; deterministic for a given mesh.
+std::vector<Vector3f> sampleSurface(const std::vector<Vector3f> &verts,
+                                    const std::vector<uint32_t> &tris,
+                                    size_t n);
+
+class ErrorMeter {
+  std::vector<Vector3f> verts;
+  std::vector<uint32_t> tris;
+  std::vector<Vector3f> samples;
+  TriangleBVH bvh;
+  size_t n_samples;
+public:
+  ErrorMeter(std::vector<Vector3f> verts, std::vector<uint32_t> tris,
+             size_t n_samples = 100000);
+  ErrorMeter(const ErrorMeter &) = delete; // bvh points into this
+  // original to lod and lod to original, in parallel
+  void measure(const std::vector<Vector3f> &lod_verts,
+               const std::vector<uint32_t> &lod_tris,
+               ErrorStats &forward, ErrorStats &backward) const;
+};
+
+#endif
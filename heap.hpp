@@ -1,7 +1,8 @@
 #ifndef HEAP_H
 #define HEAP_H
 
-#include "mesh.hpp"
+#include "queue.hpp"
+#include "stats.hpp"
 
 static inline size_t left(size_t x) {
   return x << 1;
@@ -15,7 +16,7 @@ static inline size_t mother(size_t x) {
   return x >> 1;
 }
 
-class Heap {
+class Heap : public PairQueue {
 private:
   std::vector<Pair *> pts;
 
@@ -37,6 +38,7 @@ private:
       } else if (pts[mother(i)]->error <= v->error) {
         break;
       } else {
+        STAT_INC(heap_up);
         assign(i, mother(i));
         i = mother(i);
       }
@@ -55,6 +57,7 @@ private:
         if (v->error <= pts[left(i)]->error) {
           break;
         } else {
+          STAT_INC(heap_down);
           assign(i, left(i));
           i = left(i);
         }
@@ -62,9 +65,11 @@ private:
                  v->error <= pts[right(i)]->error) {
         break;
       } else if (le(left(i), right(i))) {
+        STAT_INC(heap_down);
         assign(i, left(i));
         i = left(i);
       } else {
+        STAT_INC(heap_down);
         assign(i, right(i));
         i = right(i);
       }
@@ -83,21 +88,27 @@ public:
     for (size_t i = pts.size(); i > 1; i--) {
       down(i - 1);
     }
+    STAT_MAX(peak_pairs, pts.size() - 1);
   }
 
-  void erase(Pair *p) {
+  void erase(Pair *p) override {
     p->error = (-1.0) / 0.0; // - inf
     up(p->id);
     pop();
   }
 
-  void insert(Pair *p) {
+  void insert(Pair *p) override {
     p->id = pts.size();
     pts.push_back(p);
     up(p->id);
+    STAT_MAX(peak_pairs, pts.size() - 1);
   }
 
-  Pair *top() {
+  bool empty() const override {
+    return pts.size() == 1;
+  }
+
+  Pair *top() override {
     return pts[1];
   }
 
@@ -107,7 +118,7 @@ public:
     down(1);
   }
 
-  void update(Pair *p) {
+  void update(Pair *p) override {
     size_t id = p->id;
     if (id != 1 && !le(mother(id), id)) {
       up(id);
@@ -115,12 +126,6 @@ public:
       down(id);
     }
   }
-
-  ~Heap() { // should I ?
-    for (auto &p : pts) {
-      delete p;
-    }
-  }
 };
 
 #endif
@@ -0,0 +1,574 @@
+#include "io.hpp"
+#include "lod.hpp"
+#include "weld.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+
+static bool host_little_endian() {
+  uint16_t one = 1;
+  unsigned char c;
+  std::memcpy(&c, &one, 1);
+  return c == 1;
+}
+
+static std::string lower_extension(const std::string &path) {
+  size_t dot = path.rfind('.');
+  if (dot == std::string::npos || path.find('/', dot) != std::string::npos) {
+    return "";
+  }
+  std::string ext = path.substr(dot + 1);
+  std::transform(ext.begin(), ext.end(), ext.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  return ext;
+}
+
+MeshFormat formatByName(const std::string &name) {
+  if (name == "obj") {
+    return MeshFormat::OBJ;
+  } else if (name == "ply") {
+    return MeshFormat::PLY;
+  } else if (name == "stl") {
+    return MeshFormat::STL;
+  } else if (name == "lod") {
+    return MeshFormat::LOD;
+  }
+  throw std::runtime_error("unknown format: " + name);
+}
+
+const char *extension(MeshFormat f) {
+  switch (f) {
+  case MeshFormat::OBJ:
+    return "obj";
+  case MeshFormat::PLY:
+    return "ply";
+  case MeshFormat::STL:
+    return "stl";
+  case MeshFormat::LOD:
+    return "lod";
+  }
+  return "";
+}
+
+MeshFormat detectFormat(const std::string &path) {
+  std::string ext = lower_extension(path);
+  if (ext == "obj" || ext == "ply" || ext == "stl" || ext == "lod") {
+    return formatByName(ext);
+  }
+
+  std::ifstream in(path, std::ios::binary);
+  char head[84] = {0};
+  in.read(head, sizeof(head));
+  if (in.gcount() >= 4 && std::strncmp(head, "ply", 3) == 0 &&
+      (head[3] == '\n' || head[3] == '\r')) {
+    return MeshFormat::PLY;
+  }
+  if (in.gcount() >= 4 && std::strncmp(head, "SLOD", 4) == 0) {
+    return MeshFormat::LOD;
+  }
+  // a binary STL's size is fully determined by its triangle count
+  if (in.gcount() == 84) {
+    uint32_t n;
+    std::memcpy(&n, head + 80, 4);
+    if (!host_little_endian()) {
+      n = __builtin_bswap32(n);
+    }
+    in.seekg(0, std::ios::end);
+    if (static_cast<uint64_t>(in.tellg()) == 84 + 50 * static_cast<uint64_t>(n)) {
+      return MeshFormat::STL;
+    }
+  }
+  return MeshFormat::OBJ;
+}
+
+Mesh loadMesh(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    throw std::runtime_error("cannot open " + path);
+  }
+  std::vector<Vector3f> verts;
+  std::vector<uint32_t> tris;
+  switch (detectFormat(path)) {
+  case MeshFormat::OBJ:
+    readOBJ(in, verts, tris);
+    break;
+  case MeshFormat::PLY:
+    readPLY(in, verts, tris);
+    break;
+  case MeshFormat::STL:
+    readSTL(in, verts, tris);
+    break;
+  case MeshFormat::LOD: {
+    std::vector<LOD> lods = readLODs(in);
+    auto finest = std::max_element(lods.begin(), lods.end(),
+                                   [](const LOD &a, const LOD &b) {
+                                     return a.ratio < b.ratio;
+                                   });
+    if (finest == lods.end()) {
+      throw std::runtime_error("lod: container is empty");
+    }
+    verts = std::move(finest->verts);
+    tris = std::move(finest->tris);
+    break;
+  }
+  }
+  return Mesh(verts, std::move(tris));
+}
+
+// Bytes left in a seekable stream, SIZE_MAX when it cannot tell. Counts
+// taken from file headers are checked against this before allocating.
+static size_t bytes_left(std::istream &is) {
+  std::streampos here = is.tellg();
+  if (here == std::streampos(-1) || !is.seekg(0, std::ios::end)) {
+    is.clear();
+    return SIZE_MAX;
+  }
+  std::streampos end = is.tellg();
+  is.seekg(here);
+  return end >= here ? static_cast<size_t>(end - here) : 0;
+}
+
+// PLY
+
+enum class PlyType {INT8, UINT8, INT16, UINT16, INT32, UINT32, FLOAT32, FLOAT64};
+
+static PlyType ply_type(const std::string &name) {
+  if (name == "char" || name == "int8") {
+    return PlyType::INT8;
+  } else if (name == "uchar" || name == "uint8") {
+    return PlyType::UINT8;
+  } else if (name == "short" || name == "int16") {
+    return PlyType::INT16;
+  } else if (name == "ushort" || name == "uint16") {
+    return PlyType::UINT16;
+  } else if (name == "int" || name == "int32") {
+    return PlyType::INT32;
+  } else if (name == "uint" || name == "uint32") {
+    return PlyType::UINT32;
+  } else if (name == "float" || name == "float32") {
+    return PlyType::FLOAT32;
+  } else if (name == "double" || name == "float64") {
+    return PlyType::FLOAT64;
+  }
+  throw std::runtime_error("ply: unknown property type " + name);
+}
+
+static size_t ply_size(PlyType t) {
+  switch (t) {
+  case PlyType::INT8:
+  case PlyType::UINT8:
+    return 1;
+  case PlyType::INT16:
+  case PlyType::UINT16:
+    return 2;
+  case PlyType::INT32:
+  case PlyType::UINT32:
+  case PlyType::FLOAT32:
+    return 4;
+  case PlyType::FLOAT64:
+    return 8;
+  }
+  return 0;
+}
+
+struct PlyProperty {
+  std::string name;
+  PlyType type;
+  bool list;
+  PlyType count_type; // only for lists
+};
+
+struct PlyElement {
+  std::string name;
+  size_t count;
+  std::vector<PlyProperty> props;
+};
+
+// Decodes scalars from either a binary buffer or an ascii stream.
+class PlyReader {
+  std::istream &is;
+  bool ascii;
+  bool swap;
+  std::vector<char> buf;
+  size_t pos = 0;
+
+  template <typename T>
+  T raw() {
+    if (pos + sizeof(T) > buf.size()) {
+      throw std::runtime_error("ply: unexpected end of file");
+    }
+    char b[sizeof(T)];
+    std::memcpy(b, &buf[pos], sizeof(T));
+    pos += sizeof(T);
+    if (swap) {
+      std::reverse(b, b + sizeof(T));
+    }
+    T v;
+    std::memcpy(&v, b, sizeof(T));
+    return v;
+  }
+
+public:
+  // an upper bound on the scalars left to read
+  size_t remaining() {
+    return ascii ? bytes_left(is) : buf.size() - std::min(pos, buf.size());
+  }
+
+  PlyReader(std::istream &is, bool ascii, bool big_endian)
+    : is(is), ascii(ascii), swap(big_endian == host_little_endian()) {
+    if (!ascii) {
+      buf.assign(std::istreambuf_iterator<char>(is),
+                 std::istreambuf_iterator<char>());
+    }
+  }
+
+  double read(PlyType t) {
+    if (ascii) {
+      double v;
+      if (!(is >> v)) {
+        throw std::runtime_error("ply: unexpected end of file");
+      }
+      return v;
+    }
+    switch (t) {
+    case PlyType::INT8:
+      return raw<int8_t>();
+    case PlyType::UINT8:
+      return raw<uint8_t>();
+    case PlyType::INT16:
+      return raw<int16_t>();
+    case PlyType::UINT16:
+      return raw<uint16_t>();
+    case PlyType::INT32:
+      return raw<int32_t>();
+    case PlyType::UINT32:
+      return raw<uint32_t>();
+    case PlyType::FLOAT32:
+      return raw<float>();
+    case PlyType::FLOAT64:
+      return raw<double>();
+    }
+    return 0;
+  }
+
+  void skip(const PlyProperty &p) {
+    size_t n = p.list ? static_cast<size_t>(read(p.count_type)) : 1;
+    if (ascii) {
+      for (size_t i = 0; i < n; i++) {
+        read(p.type);
+      }
+    } else {
+      pos += n * ply_size(p.type);
+    }
+  }
+};
+
+void readPLY(std::istream &is,
+             std::vector<Vector3f> &verts, std::vector<uint32_t> &tris) {
+  std::string line;
+  std::getline(is, line);
+  if (line.compare(0, 3, "ply") != 0) {
+    throw std::runtime_error("ply: bad magic");
+  }
+
+  std::vector<PlyElement> elements;
+  bool ascii = false, big_endian = false;
+  while (std::getline(is, line)) {
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    std::istringstream ls(line);
+    std::string key;
+    ls >> key;
+    if (key == "format") {
+      std::string f;
+      ls >> f;
+      if (f == "ascii") {
+        ascii = true;
+      } else if (f == "binary_big_endian") {
+        big_endian = true;
+      } else if (f != "binary_little_endian") {
+        throw std::runtime_error("ply: unknown format " + f);
+      }
+    } else if (key == "element") {
+      PlyElement e;
+      ls >> e.name >> e.count;
+      elements.push_back(e);
+    } else if (key == "property") {
+      if (elements.empty()) {
+        throw std::runtime_error("ply: property outside of an element");
+      }
+      PlyProperty p;
+      std::string type;
+      ls >> type;
+      p.list = type == "list";
+      if (p.list) {
+        std::string count_type;
+        ls >> count_type >> type;
+        p.count_type = ply_type(count_type);
+      }
+      p.type = ply_type(type);
+      ls >> p.name;
+      elements.back().props.push_back(p);
+    } else if (key == "end_header") {
+      break;
+    }
+  }
+
+  PlyReader r(is, ascii, big_endian);
+  for (auto &e : elements) {
+    if (e.name == "vertex") {
+      verts.reserve(std::min(e.count, r.remaining()));
+      for (size_t i = 0; i < e.count; i++) {
+        real c[3] = {0, 0, 0};
+        for (auto &p : e.props) {
+          if (!p.list && (p.name == "x" || p.name == "y" || p.name == "z")) {
+            c[p.name[0] - 'x'] = r.read(p.type);
+          } else {
+            r.skip(p);
+          }
+        }
+        verts.emplace_back(c[0], c[1], c[2]);
+      }
+    } else if (e.name == "face") {
+      tris.reserve(3 * std::min(e.count, r.remaining()));
+      std::vector<uint32_t> vs;
+      for (size_t i = 0; i < e.count; i++) {
+        for (auto &p : e.props) {
+          if (p.list && (p.name == "vertex_indices" || p.name == "vertex_index")) {
+            size_t n = r.read(p.count_type);
+            vs.clear();
+            for (size_t j = 0; j < n; j++) {
+              double v = r.read(p.type);
+              if (v < 0 || v >= verts.size()) {
+                throw std::runtime_error("ply: vertex index out of range");
+              }
+              vs.push_back(v);
+            }
+            for (size_t j = 1; j + 1 < vs.size(); j++) {
+              tris.push_back(vs[0]);
+              tris.push_back(vs[j]);
+              tris.push_back(vs[j + 1]);
+            }
+          } else {
+            r.skip(p);
+          }
+        }
+      }
+    } else {
+      for (size_t i = 0; i < e.count; i++) {
+        for (auto &p : e.props) {
+          r.skip(p);
+        }
+      }
+    }
+  }
+}
+
+template <typename T>
+static void put_le(std::ostream &os, T v) {
+  char b[sizeof(T)];
+  std::memcpy(b, &v, sizeof(T));
+  if (!host_little_endian()) {
+    std::reverse(b, b + sizeof(T));
+  }
+  os.write(b, sizeof(T));
+}
+
+void writePLY(std::ostream &os, const std::vector<Vector3f> &verts,
+              const std::vector<uint32_t> &tris) {
+  os << "ply\n"
+     << "format binary_little_endian 1.0\n"
+     << "element vertex " << verts.size() << '\n'
+     << "property float x\n"
+     << "property float y\n"
+     << "property float z\n"
+     << "element face " << tris.size() / 3 << '\n'
+     << "property list uchar int vertex_indices\n"
+     << "end_header\n";
+  for (auto &v : verts) {
+    put_le<float>(os, v.x);
+    put_le<float>(os, v.y);
+    put_le<float>(os, v.z);
+  }
+  for (size_t i = 0; i < tris.size(); i += 3) {
+    put_le<uint8_t>(os, 3);
+    put_le<int32_t>(os, tris[i]);
+    put_le<int32_t>(os, tris[i + 1]);
+    put_le<int32_t>(os, tris[i + 2]);
+  }
+}
+
+// STL
+
+void readSTL(std::istream &is,
+             std::vector<Vector3f> &verts, std::vector<uint32_t> &tris) {
+  char head[84];
+  if (!is.read(head, sizeof(head))) {
+    throw std::runtime_error("stl: truncated header");
+  }
+  bool swap = !host_little_endian();
+  uint32_t n;
+  std::memcpy(&n, head + 80, 4);
+  if (swap) {
+    n = __builtin_bswap32(n);
+  }
+
+  // ascii files start with "solid", and their text rarely spells out a
+  // triangle count that matches the length of the file
+  size_t left = bytes_left(is);
+  if (left < 50 * static_cast<size_t>(n)) {
+    if (std::strncmp(head, "solid", 5) == 0) {
+      throw std::runtime_error("stl: ascii STL is not supported");
+    }
+    throw std::runtime_error("stl: truncated triangle data");
+  }
+
+  if (left != SIZE_MAX) {
+    verts.reserve(3 * static_cast<size_t>(n));
+    tris.reserve(3 * static_cast<size_t>(n));
+  }
+  char rec[50];
+  for (size_t i = 0; i < n; i++) {
+    if (!is.read(rec, sizeof(rec))) {
+      throw std::runtime_error("stl: truncated triangle data");
+    }
+    // skip the normal, the attribute count follows the corners
+    const char *c = rec + 12;
+    for (size_t j = 0; j < 3; j++) {
+      uint32_t bits[3];
+      std::memcpy(bits, c + 12 * j, 12);
+      if (swap) {
+        for (auto &b : bits) {
+          b = __builtin_bswap32(b);
+        }
+      }
+      float f[3];
+      std::memcpy(f, bits, 12);
+      tris.push_back(verts.size());
+      verts.emplace_back(f[0], f[1], f[2]);
+    }
+  }
+  weldVertices(verts, tris, 0);
+}
+
+// OBJ
+
+void readOBJ(std::istream &is,
+             std::vector<Vector3f> &verts, std::vector<uint32_t> &tris,
+             std::vector<ObjGroup> *groups) {
+  std::string op;
+  std::string garbage;
+  while (is >> op) {
+    if (op == "v") {
+      real x, y, z;
+      is >> x >> y >> z;
+      verts.emplace_back(x, y, z);
+    } else if (op == "f") {
+      std::vector<size_t> vs;
+      size_t v;
+      is >> v;
+      if (is.peek() == '/') {
+        char slash;
+        size_t vt;
+        is >> slash >> vt;
+        do {
+          vs.emplace_back(v);
+          is >> v >> slash >> vt;
+        } while (is.good());
+      } else {
+        do {
+          vs.emplace_back(v);
+          is >> v;
+        } while (is.good());
+      }
+      is.clear();
+      for (size_t i = 1; i < vs.size() - 1; i++) {
+        tris.push_back(vs[0] - 1);
+        tris.push_back(vs[i] - 1);
+        tris.push_back(vs[i + 1] - 1);
+      }
+    } else if (groups && (op == "o" || op == "g")) {
+      std::string name;
+      std::getline(is, name);
+      size_t b = name.find_first_not_of(" \t"), e = name.find_last_not_of(" \t\r");
+      name = b == std::string::npos ? "" : name.substr(b, e - b + 1);
+      groups->push_back({op + ' ' + name, tris.size() / 3});
+    } else {
+      std::getline(is, garbage);
+    }
+  }
+}
+
+std::vector<ObjPart> splitGroups(const std::vector<Vector3f> &verts,
+                                 const std::vector<uint32_t> &tris,
+                                 const std::vector<ObjGroup> &groups) {
+  std::vector<ObjPart> parts;
+  std::vector<uint32_t> local(verts.size());
+  std::vector<size_t> seen(verts.size(), 0); // part number + 1
+  for (size_t g = 0; g <= groups.size(); g++) {
+    size_t first = g == 0 ? 0 : groups[g - 1].first;
+    size_t last = g == groups.size() ? tris.size() / 3 : groups[g].first;
+    if (first == last) {
+      continue;
+    }
+    ObjPart p;
+    p.header = g == 0 ? "" : groups[g - 1].header;
+    for (size_t i = 3 * first; i < 3 * last; i++) {
+      uint32_t v = tris[i];
+      if (seen[v] != parts.size() + 1) {
+        seen[v] = parts.size() + 1;
+        local[v] = p.verts.size();
+        p.verts.push_back(verts[v]);
+      }
+      p.tris.push_back(local[v]);
+    }
+    parts.push_back(std::move(p));
+  }
+  return parts;
+}
+
+void writeOBJ(std::ostream &os, const std::vector<ObjPart> &parts, int precision) {
+  os << std::setprecision(precision);
+  size_t base = 1;
+  for (auto &p : parts) {
+    if (!p.header.empty()) {
+      os << p.header << '\n';
+    }
+    for (auto &v : p.verts) {
+      os << "v" << ' '
+         << v.x << ' '
+         << v.y << ' '
+         << v.z << '\n';
+    }
+    for (size_t i = 0; i < p.tris.size(); i += 3) {
+      os << "f" << ' '
+         << p.tris[i] + base << ' '
+         << p.tris[i + 1] + base << ' '
+         << p.tris[i + 2] + base << '\n';
+    }
+    base += p.verts.size();
+  }
+}
+
+void writeOBJ(std::ostream &os, const std::vector<Vector3f> &verts,
+              const std::vector<uint32_t> &tris, int precision) {
+  os << std::setprecision(precision);
+  for (auto &v : verts) {
+    os << "v" << ' '
+       << v.x << ' '
+       << v.y << ' '
+       << v.z << '\n';
+  }
+  for (size_t i = 0; i < tris.size(); i += 3) {
+    os << "f" << ' '
+       << tris[i] + 1 << ' '
+       << tris[i + 1] + 1 << ' '
+       << tris[i + 2] + 1 << '\n';
+  }
+}
@@ -0,0 +1,58 @@
+#ifndef IO_HPP
+#define IO_HPP
+
+#include "mesh.hpp"
+#include <string>
+
+// Readers and writers for the formats other than text OBJ. They work on
+// plain buffers: a vertex array and three vertex indices per triangle.
+// Malformed input is reported by throwing std::runtime_error.
+
+enum class MeshFormat {OBJ, PLY, STL, LOD}; // LOD: see lod.hpp
+
+// by extension, falling back to sniffing the header
+MeshFormat detectFormat(const std::string &path);
+MeshFormat formatByName(const std::string &name);
+const char *extension(MeshFormat f);
+
+// a LOD container loads as its finest level
+Mesh loadMesh(const std::string &path);
+
+// an "o" or "g" line and the first triangle after it
+struct ObjGroup {
+  std::string header;
+  size_t first;
+};
+
+// one group as a mesh of its own
+struct ObjPart {
+  std::string header; // empty for faces before the first group
+  std::vector<Vector3f> verts;
+  std::vector<uint32_t> tris;
+};
+
+// text OBJ; groups are only recorded when asked for
+void readOBJ(std::istream &is,
+             std::vector<Vector3f> &verts, std::vector<uint32_t> &tris,
+             std::vector<ObjGroup> *groups = nullptr);
+// empty groups are dropped; vertices shared between groups are duplicated
+std::vector<ObjPart> splitGroups(const std::vector<Vector3f> &verts,
+                                 const std::vector<uint32_t> &tris,
+                                 const std::vector<ObjGroup> &groups);
+
+// binary (either endianness) and ascii PLY; polygons are fanned
+void readPLY(std::istream &is,
+             std::vector<Vector3f> &verts, std::vector<uint32_t> &tris);
+// binary STL; duplicated corners are welded by exact position
+void readSTL(std::istream &is,
+             std::vector<Vector3f> &verts, std::vector<uint32_t> &tris);
+
+void writeOBJ(std::ostream &os, const std::vector<Vector3f> &verts,
+              const std::vector<uint32_t> &tris, int precision = 8);
+void writeOBJ(std::ostream &os, const std::vector<ObjPart> &parts,
+              int precision = 8);
+// binary little endian, float coordinates
+void writePLY(std::ostream &os, const std::vector<Vector3f> &verts,
+              const std::vector<uint32_t> &tris);
+
+#endif
@@ -2,27 +2,62 @@
 #define KD_HPP
 
 #include <memory>
+#include <functional>
+#include <algorithm>
 #include "mesh.hpp"
+#include "stats.hpp"
 
 using std::shared_ptr;
 using std::make_shared;
 
 enum class KDAxis {KDX, KDY, KDZ};
 
+inline real axisCoord(const Vector3f &v, KDAxis a) {
+  switch (a) {
+  case KDAxis::KDX:
+    return v.x;
+  case KDAxis::KDY:
+    return v.y;
+  default:
+    return v.z;
+  }
+}
+
+// candidates found so far by knnSearch, a max-heap on distance
+typedef std::vector<std::pair<real, Point *>> KDNearest;
+
 class KDTreeBase {
 public:
   virtual void
   radiusSearch(const Vector3f &ref, real r, std::vector<Point *> &ret) = 0;
+  // keeps in best the (at most) k closest accepted points within r
+  virtual void
+  knnSearch(const Vector3f &ref, size_t k, real r,
+            const std::function<bool (Point *)> &accept, KDNearest &best) = 0;
   virtual ~KDTreeBase() = default;
 };
 
 class KDTree {
+  friend class KDTreeNode;
   shared_ptr<KDTreeBase> t;
 public:
   KDTree(shared_ptr<KDTreeBase> t) : t(t) {}
   void radiusSearch(const Vector3f &ref, real r, std::vector<Point *> &ret) {
     t->radiusSearch(ref, r, ret);
   }
+  // appends the k closest accepted points within r, nearest first
+  void knnSearch(const Vector3f &ref, size_t k, real r,
+                 const std::function<bool (Point *)> &accept,
+                 std::vector<Point *> &ret) {
+    KDNearest best;
+    if (k > 0) {
+      t->knnSearch(ref, k, r, accept, best);
+    }
+    std::sort_heap(best.begin(), best.end());
+    for (auto &b : best) {
+      ret.push_back(b.second);
+    }
+  }
 };
 
 class KDTreeLeaf : public KDTreeBase {
@@ -31,10 +66,26 @@ public:
   KDTreeLeaf(Point *p) : p(p) {}
   virtual void
   radiusSearch(const Vector3f &ref, real r, std::vector<Point *> &ret) override {
+    STAT_INC(kd_visited);
     if (distance(ref, *p) <= r) {
       ret.push_back(p);
     }
   }
+  virtual void
+  knnSearch(const Vector3f &ref, size_t k, real r,
+            const std::function<bool (Point *)> &accept, KDNearest &best) override {
+    STAT_INC(kd_visited);
+    real d = distance(ref, *p);
+    if (d > r || (best.size() == k && d >= best.front().first) || !accept(p)) {
+      return;
+    }
+    if (best.size() == k) {
+      std::pop_heap(best.begin(), best.end());
+      best.pop_back();
+    }
+    best.emplace_back(d, p);
+    std::push_heap(best.begin(), best.end());
+  }
   ~KDTreeLeaf() = default;
 };
 
@@ -49,18 +100,8 @@ public:
     : low(low), hig(hig), axis(axis), coord(coord) {}
   virtual void
   radiusSearch(const Vector3f &ref, real r, std::vector<Point *> &ret) override {
-    real refc;
-    switch (axis) {
-    case KDAxis::KDX:
-      refc = ref.x;
-      break;
-    case KDAxis::KDY:
-      refc = ref.y;
-      break;
-    case KDAxis::KDZ:
-      refc = ref.z;
-      break;
-    }
+    STAT_INC(kd_visited);
+    real refc = axisCoord(ref, axis);
     if (refc <= coord) {
       low.radiusSearch(ref, r, ret);
       if (coord - refc < r) {
@@ -73,6 +114,26 @@ public:
       }
     }
   }
+  virtual void
+  knnSearch(const Vector3f &ref, size_t k, real r,
+            const std::function<bool (Point *)> &accept, KDNearest &best) override {
+    STAT_INC(kd_visited);
+    real refc = axisCoord(ref, axis);
+    auto bound = [&best, k, r]() {
+      return best.size() == k ? std::min(r, best.front().first) : r;
+    };
+    if (refc <= coord) {
+      low.t->knnSearch(ref, k, r, accept, best);
+      if (coord - refc < bound()) {
+        hig.t->knnSearch(ref, k, r, accept, best);
+      }
+    } else {
+      hig.t->knnSearch(ref, k, r, accept, best);
+      if (refc - coord <= bound()) {
+        low.t->knnSearch(ref, k, r, accept, best);
+      }
+    }
+  }
   ~KDTreeNode() = default;
 };
 
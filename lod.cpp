@@ -0,0 +1,197 @@
+#include "lod.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+static const char MAGIC[4] = {'S', 'L', 'O', 'D'};
+static const uint8_t VERSION = 1;
+// most vertices or triangles reserved ahead of decoding them
+static const uint64_t RESERVE_LIMIT = 1 << 20;
+
+static void put_varint(std::string &buf, uint64_t v) {
+  while (v >= 0x80) {
+    buf.push_back(static_cast<char>((v & 0x7f) | 0x80));
+    v >>= 7;
+  }
+  buf.push_back(static_cast<char>(v));
+}
+
+static uint64_t zigzag(int64_t v) {
+  return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v) {
+  return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+static void put_f64(std::string &buf, double d) {
+  uint64_t u;
+  std::memcpy(&u, &d, 8);
+  for (int i = 0; i < 8; i++) {
+    buf.push_back(static_cast<char>(u >> (8 * i)));
+  }
+}
+
+LODWriter::LODWriter(std::ostream &os, int bits)
+  : os(os), bits(bits), finished(false) {
+  if (bits < 1 || bits > 31) {
+    throw std::runtime_error("lod: bit depth must be within 1..31");
+  }
+  os.write(MAGIC, 4);
+  os.put(VERSION);
+  os.put(static_cast<char>(bits));
+}
+
+void LODWriter::add(real ratio, const std::vector<Vector3f> &verts,
+                    const std::vector<uint32_t> &tris) {
+  Vector3f lo, hi;
+  if (!verts.empty()) {
+    lo = hi = verts[0];
+  }
+  for (auto &v : verts) {
+    lo = Vector3f(std::min(lo.x, v.x), std::min(lo.y, v.y), std::min(lo.z, v.z));
+    hi = Vector3f(std::max(hi.x, v.x), std::max(hi.y, v.y), std::max(hi.z, v.z));
+  }
+
+  std::string buf;
+  buf.reserve(4 * verts.size() + 2 * tris.size() + 64);
+  buf.push_back(1);
+  put_f64(buf, ratio);
+  put_f64(buf, lo.x); put_f64(buf, lo.y); put_f64(buf, lo.z);
+  put_f64(buf, hi.x); put_f64(buf, hi.y); put_f64(buf, hi.z);
+  put_varint(buf, verts.size());
+  put_varint(buf, tris.size() / 3);
+
+  real levels = static_cast<real>((1u << bits) - 1);
+  real lo_[3] = {lo.x, lo.y, lo.z}, hi_[3] = {hi.x, hi.y, hi.z};
+  real scale[3];
+  for (int c = 0; c < 3; c++) {
+    scale[c] = hi_[c] > lo_[c] ? levels / (hi_[c] - lo_[c]) : 0;
+  }
+  int64_t prev[3] = {0, 0, 0};
+  for (auto &v : verts) {
+    real c_[3] = {v.x, v.y, v.z};
+    for (int c = 0; c < 3; c++) {
+      int64_t q = std::llround((c_[c] - lo_[c]) * scale[c]);
+      put_varint(buf, zigzag(q - prev[c]));
+      prev[c] = q;
+    }
+  }
+
+  int64_t first = 0;
+  for (size_t i = 0; i < tris.size(); i += 3) {
+    put_varint(buf, zigzag(int64_t(tris[i]) - first));
+    first = tris[i];
+    put_varint(buf, zigzag(int64_t(tris[i + 1]) - first));
+    put_varint(buf, zigzag(int64_t(tris[i + 2]) - first));
+  }
+  os.write(buf.data(), buf.size());
+}
+
+void LODWriter::finish() {
+  if (!finished) {
+    os.put(0);
+    os.flush();
+    finished = true;
+  }
+}
+
+class ByteReader {
+  std::istream &is;
+public:
+  ByteReader(std::istream &is) : is(is) {}
+
+  uint8_t byte() {
+    int c = is.get();
+    if (c == EOF) {
+      throw std::runtime_error("lod: unexpected end of file");
+    }
+    return static_cast<uint8_t>(c);
+  }
+
+  uint64_t varint() {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      uint8_t b = byte();
+      v |= static_cast<uint64_t>(b & 0x7f) << shift;
+      if (!(b & 0x80)) {
+        return v;
+      }
+    }
+    throw std::runtime_error("lod: malformed varint");
+  }
+
+  double f64() {
+    uint64_t u = 0;
+    for (int i = 0; i < 8; i++) {
+      u |= static_cast<uint64_t>(byte()) << (8 * i);
+    }
+    double d;
+    std::memcpy(&d, &u, 8);
+    return d;
+  }
+};
+
+std::vector<LOD> readLODs(std::istream &is) {
+  char magic[4];
+  if (!is.read(magic, 4) || std::memcmp(magic, MAGIC, 4) != 0) {
+    throw std::runtime_error("lod: bad magic");
+  }
+  ByteReader r(is);
+  if (r.byte() != VERSION) {
+    throw std::runtime_error("lod: unsupported version");
+  }
+  int bits = r.byte();
+  if (bits < 1 || bits > 31) {
+    throw std::runtime_error("lod: bad bit depth");
+  }
+  real levels = static_cast<real>((1u << bits) - 1);
+
+  std::vector<LOD> lods;
+  while (r.byte() != 0) {
+    LOD l;
+    l.ratio = r.f64();
+    real lo[3], hi[3];
+    for (auto &c : lo) {
+      c = r.f64();
+    }
+    for (auto &c : hi) {
+      c = r.f64();
+    }
+    uint64_t n_verts = r.varint(), n_tris = r.varint();
+    if (n_verts > UINT32_MAX || n_tris > UINT32_MAX / 3) {
+      throw std::runtime_error("lod: bad level size");
+    }
+
+    // the counts are not trusted for more than a first reservation; short
+    // data runs into the end of the stream
+    l.verts.reserve(std::min<uint64_t>(n_verts, RESERVE_LIMIT));
+    int64_t q[3] = {0, 0, 0};
+    for (size_t i = 0; i < n_verts; i++) {
+      real c_[3];
+      for (int c = 0; c < 3; c++) {
+        q[c] += unzigzag(r.varint());
+        c_[c] = lo[c] + q[c] * (hi[c] - lo[c]) / levels;
+      }
+      l.verts.emplace_back(c_[0], c_[1], c_[2]);
+    }
+
+    l.tris.reserve(3 * std::min<uint64_t>(n_tris, RESERVE_LIMIT));
+    int64_t first = 0;
+    for (size_t i = 0; i < n_tris; i++) {
+      first += unzigzag(r.varint());
+      int64_t v[3] = {first,
+                      first + unzigzag(r.varint()),
+                      first + unzigzag(r.varint())};
+      for (int j = 0; j < 3; j++) {
+        if (v[j] < 0 || v[j] >= static_cast<int64_t>(n_verts)) {
+          throw std::runtime_error("lod: vertex index out of range");
+        }
+        l.tris.push_back(v[j]);
+      }
+    }
+    lods.push_back(std::move(l));
+  }
+  return lods;
+}
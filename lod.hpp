@@ -0,0 +1,43 @@
+#ifndef LOD_HPP
+#define LOD_HPP
+
+#include "math.hpp"
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+// Compact binary container holding several LODs of one mesh.
+//
+//   "SLOD" u8:version u8:bits
+//   per LOD:  u8:1 f64:ratio f64[3]:min f64[3]:max
+//             varint:#vertices varint:#triangles
+//             positions, quantized to bits per component within [min, max]
+//             and stored as zigzag varint deltas to the previous vertex
+//             indices, as zigzag varint deltas: the first corner of a
+//             triangle to the first corner of the previous one, the other
+//             two to the first corner
+//   u8:0
+//
+// Doubles are little endian. Malformed input throws std::runtime_error.
+
+class LODWriter {
+  std::ostream &os;
+  int bits;
+  bool finished;
+public:
+  LODWriter(std::ostream &os, int bits = 16);
+  void add(real ratio, const std::vector<Vector3f> &verts,
+           const std::vector<uint32_t> &tris);
+  void finish();
+  ~LODWriter() { finish(); }
+};
+
+struct LOD {
+  real ratio;
+  std::vector<Vector3f> verts;
+  std::vector<uint32_t> tris;
+};
+
+std::vector<LOD> readLODs(std::istream &is);
+
+#endif
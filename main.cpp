@@ -1,17 +1,473 @@
 #include "mesh.hpp"
+#include "stats.hpp"
+#include "io.hpp"
+#include "lod.hpp"
+#include "order.hpp"
+#include "parallel.hpp"
+#include "error.hpp"
 #include <fstream>
 #include <sstream>
+#include <string>
+#include <memory>
+#include <numeric>
+#include <cmath>
+#include <iomanip>
+#include <stdexcept>
+#include <cctype>
+#include <atomic>
+#include <array>
+
+static void usage() {
+  std::cerr
+    << "Usage: <executable> [--stats] [--budget <ms>] [--format obj|ply|lod] [--bits <n>] [--optimize-order] [--split-groups [--weighted]] [--threads <n>] [--weld <tolerance>] [--error [--error-samples <n>]] [--huge-pages] [--hugetlb] [--numa-interleave] [--queue heap|bucket] [--compare-queues] [--knn <k>] [--max-pairs <n>] [--max-memory <MB>] <input file> <output file prefix> <ratio[,ratio]*> <threshold>\n"
+    << "       <executable> --decode [--format obj|ply] <lod file> <output file prefix>"
+    << std::endl;
+  exit(1);
+}
+
+// a whole non-negative number, else usage()
+static size_t count_arg(const char *s) {
+  size_t used = 0, v = 0;
+  try {
+    if (std::isdigit(static_cast<unsigned char>(*s))) {
+      v = std::stoull(s, &used);
+    }
+  } catch (std::logic_error &) {
+    used = 0; // out of range
+  }
+  if (used == 0 || s[used] != '\0') {
+    std::cerr << "not a count: " << s << std::endl;
+    usage();
+  }
+  return v;
+}
+
+static real real_arg(const char *s) {
+  size_t used = 0;
+  real v = 0;
+  try {
+    v = std::stod(s, &used);
+  } catch (std::logic_error &) {
+    used = 0;
+  }
+  if (used == 0 || s[used] != '\0') {
+    std::cerr << "not a number: " << s << std::endl;
+    usage();
+  }
+  return v;
+}
+
+static void write_mesh(const std::string &prefix, real ratio, MeshFormat format,
+                       const std::vector<Vector3f> &verts,
+                       const std::vector<uint32_t> &tris) {
+  std::ostringstream path;
+  path << prefix << '_' << ratio << '.' << extension(format);
+  std::ofstream out(path.str(), std::ios::binary);
+  if (format == MeshFormat::PLY) {
+    writePLY(out, verts, tris);
+  } else {
+    writeOBJ(out, verts, tris);
+  }
+  out.close();
+}
+
+static void reorder_for_gpu(std::vector<Vector3f> &verts,
+                            std::vector<uint32_t> &tris) {
+  optimizeVertexCache(tris, verts.size());
+  optimizeVertexFetch(verts, tris);
+}
+
+static void report_error(const ErrorMeter *meter, real ratio,
+                         const std::vector<Vector3f> &verts,
+                         const std::vector<uint32_t> &tris) {
+  if (!meter) {
+    return;
+  }
+  STAT_PHASE(phase, "error " + std::to_string(ratio));
+  ErrorStats fw, bw;
+  meter->measure(verts, tris, fw, bw);
+  std::cerr << "ratio " << ratio << ": error"
+            << " max " << std::max(fw.max, bw.max)
+            << " | original->lod max " << fw.max << " mean " << fw.mean
+            << " rms " << fw.rms
+            << " | lod->original max " << bw.max << " mean " << bw.mean
+            << " rms " << bw.rms << std::endl;
+}
+
+// Simplifies copies of m with both queue backends and prints their speed
+// and error side by side. No files are written.
+static void compare_queues(const Mesh &m, const std::vector<real> &ratios,
+                           SimplifyOptions opts, size_t error_samples) {
+  using clock = std::chrono::steady_clock;
+  struct Row {
+    real ratio;
+    double seconds; // since simplify began, measuring excluded
+    size_t collapses;
+    ErrorStats fw, bw;
+  };
+
+  std::vector<Vector3f> verts;
+  std::vector<uint32_t> tris;
+  m.extract(verts, tris);
+  size_t n_points = verts.size();
+  ErrorMeter meter(std::move(verts), std::move(tris), error_samples);
+
+  opts.verbose = false;
+  std::vector<Row> rows[2];
+  const char *names[2] = {"heap", "bucket"};
+  QueueKind kinds[2] = {QueueKind::HEAP, QueueKind::BUCKET};
+  for (int q = 0; q < 2; q++) {
+    Mesh copy = m;
+    opts.queue = kinds[q];
+    std::chrono::duration<double> excluded(0);
+    auto start = clock::now();
+    copy.simplify([&](Mesh &m, real ratio) {
+                    auto t = clock::now();
+                    Row r;
+                    r.ratio = ratio;
+                    r.seconds = std::chrono::duration<double>(
+                      t - start - excluded).count();
+                    std::vector<Vector3f> verts;
+                    std::vector<uint32_t> tris;
+                    m.extract(verts, tris);
+                    r.collapses = n_points - verts.size();
+                    meter.measure(verts, tris, r.fw, r.bw);
+                    rows[q].push_back(r);
+                    excluded += clock::now() - t;
+                  },
+                  ratios, opts);
+  }
+
+  std::cerr << std::left << std::setw(8) << "queue"
+            << std::right << std::setw(8) << "ratio"
+            << std::setw(12) << "seconds" << std::setw(14) << "collapses/s"
+            << std::setw(14) << "max error" << std::setw(14) << "rms error"
+            << '\n';
+  for (int q = 0; q < 2; q++) {
+    for (auto &r : rows[q]) {
+      std::cerr << std::left << std::setw(8) << names[q]
+                << std::right << std::setw(8) << r.ratio
+                << std::setw(12) << r.seconds
+                << std::setw(14) << r.collapses / r.seconds
+                << std::setw(14) << std::max(r.fw.max, r.bw.max)
+                << std::setw(14) << std::max(r.fw.rms, r.bw.rms) << '\n';
+    }
+  }
+  for (size_t i = 0; i < std::min(rows[0].size(), rows[1].size()); i++) {
+    Row &h = rows[0][i], &b = rows[1][i];
+    real h_rms = std::max(h.fw.rms, h.bw.rms), b_rms = std::max(b.fw.rms, b.bw.rms);
+    real h_max = std::max(h.fw.max, h.bw.max), b_max = std::max(b.fw.max, b.bw.max);
+    std::cerr << "ratio " << h.ratio << ": bucket is "
+              << h.seconds / b.seconds << "x as fast, max error "
+              << std::showpos << 100 * (b_max / h_max - 1) << "%, rms error "
+              << 100 * (b_rms / h_rms - 1) << "%" << std::noshowpos
+              << std::endl;
+  }
+}
+
+static void concat_parts(const std::vector<ObjPart> &parts,
+                         std::vector<Vector3f> &verts,
+                         std::vector<uint32_t> &tris) {
+  for (auto &p : parts) {
+    size_t base = verts.size();
+    verts.insert(verts.end(), p.verts.begin(), p.verts.end());
+    for (auto v : p.tris) {
+      tris.push_back(base + v);
+    }
+  }
+}
+
+// Simplifies every o/g group of an OBJ as a mesh of its own, concurrently,
+// and writes each ratio back as one OBJ that keeps the group names.
+static void simplify_groups(const std::string &input, const std::string &prefix,
+                            std::vector<real> ratios, const SimplifyOptions &opts,
+                            bool weighted, bool reorder, real weld,
+                            size_t error_samples) {
+  std::vector<ObjPart> parts;
+  {
+    STAT_PHASE(phase, "read");
+    std::ifstream in(input);
+    if (!in) {
+      throw std::runtime_error("cannot open " + input);
+    }
+    std::vector<Vector3f> verts;
+    std::vector<uint32_t> tris;
+    std::vector<ObjGroup> groups;
+    readOBJ(in, verts, tris, &groups);
+    parts = splitGroups(verts, tris, groups);
+  }
+  std::cerr << parts.size() << " groups, " << workers() << " threads"
+            << std::endl;
+
+  std::unique_ptr<ErrorMeter> meter;
+  if (error_samples) {
+    std::vector<Vector3f> verts;
+    std::vector<uint32_t> tris;
+    concat_parts(parts, verts, tris);
+    meter = std::make_unique<ErrorMeter>(std::move(verts), std::move(tris),
+                                         error_samples);
+  }
+
+  // simplify emits the ratios largest first
+  std::sort(ratios.rbegin(), ratios.rend());
+  std::vector<std::vector<real>> part_ratios(parts.size(), ratios);
+  if (weighted) {
+    // Share each global vertex target among the groups in proportion to the
+    // square root of their sizes, so small parts keep relatively more.
+    real total = 0, weights = 0;
+    for (auto &p : parts) {
+      total += p.verts.size();
+      weights += std::sqrt(static_cast<real>(p.verts.size()));
+    }
+    for (size_t g = 0; g < parts.size(); g++) {
+      real n = parts[g].verts.size();
+      for (auto &r : part_ratios[g]) {
+        r = std::min<real>(1, r * total * std::sqrt(n) / weights / n);
+      }
+    }
+  }
+
+  // largest groups first to keep the tail short
+  std::vector<size_t> order(parts.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&parts](size_t a, size_t b) {
+    return parts[a].verts.size() > parts[b].verts.size();
+  });
+
+  std::vector<std::vector<ObjPart>> out(ratios.size(),
+                                        std::vector<ObjPart>(parts.size()));
+  std::vector<size_t> produced(parts.size(), 0);
+  // groups run side by side, so each gets a share of the memory budget in
+  // proportion to its size
+  size_t n_verts = 0;
+  for (auto &p : parts) {
+    n_verts += p.verts.size();
+  }
+  std::vector<std::string> errors(parts.size());
+  std::atomic<size_t> skipped(0);
+  // vertex cache misses before and after reordering and the triangles
+  // they were counted over, per ratio and group
+  std::vector<std::vector<std::array<real, 3>>> misses(
+    ratios.size(), std::vector<std::array<real, 3>>(parts.size()));
+  parallelFor(parts.size(), [&](size_t i) {
+    size_t g = order[i];
+    // past the deadline, a group that has not started yet is passed through
+    if (opts.deadline && std::chrono::steady_clock::now() >= *opts.deadline) {
+      for (auto &r : out) {
+        r[g] = {parts[g].header, parts[g].verts, parts[g].tris};
+      }
+      skipped += 1;
+      return;
+    }
+    SimplifyOptions o = opts;
+    o.verbose = false;
+    o.lock_boundary = true; // seams with the neighbouring groups
+    if (opts.memory_budget) {
+      o.memory_budget = std::max<size_t>(
+        1, opts.memory_budget * parts[g].verts.size() / std::max<size_t>(1, n_verts));
+    }
+    Mesh m(parts[g].verts, std::move(parts[g].tris));
+    parts[g].verts = std::vector<Vector3f>();
+    if (weld >= 0) {
+      m.weld(weld);
+    }
+    try {
+      m.simplify([&out, &produced, &parts, &misses, g, reorder](Mesh &m, real) {
+                   size_t r = produced[g]++;
+                   ObjPart &p = out[r][g];
+                   p.header = parts[g].header;
+                   m.extract(p.verts, p.tris);
+                   if (reorder) {
+                     real n_tris = p.tris.size() / 3;
+                     real before = acmr(p.tris, p.verts.size()) * n_tris;
+                     reorder_for_gpu(p.verts, p.tris);
+                     misses[r][g] = {before,
+                                     acmr(p.tris, p.verts.size()) * n_tris,
+                                     n_tris};
+                   }
+                 },
+                 part_ratios[g], o);
+    } catch (std::runtime_error &e) {
+      errors[g] = (parts[g].header.empty() ? "ungrouped faces" : parts[g].header) +
+        ": " + e.what();
+    }
+  });
+  for (auto &e : errors) {
+    if (!e.empty()) {
+      throw std::runtime_error(e);
+    }
+  }
+  if (skipped) {
+    std::cerr << "time budget: " << skipped << " of " << parts.size()
+              << " groups passed through unsimplified" << std::endl;
+  }
+
+  for (size_t r = 0; r < ratios.size(); r++) {
+    if (reorder) {
+      real before = 0, after = 0, n_tris = 0;
+      for (auto &m : misses[r]) {
+        before += m[0];
+        after += m[1];
+        n_tris += m[2];
+      }
+      if (n_tris > 0) {
+        std::cerr << "ratio " << ratios[r] << ": ACMR " << before / n_tris
+                  << " -> " << after / n_tris << std::endl;
+      }
+    }
+    if (meter) {
+      std::vector<Vector3f> verts;
+      std::vector<uint32_t> tris;
+      concat_parts(out[r], verts, tris);
+      report_error(meter.get(), ratios[r], verts, tris);
+    }
+    STAT_PHASE(phase, "output " + std::to_string(ratios[r]));
+    std::ostringstream path;
+    path << prefix << '_' << ratios[r] << ".obj";
+    std::ofstream os(path.str());
+    writeOBJ(os, out[r]);
+  }
+}
+
+static void decode(const std::string &input, const std::string &prefix,
+                   MeshFormat format) {
+  std::ifstream in(input, std::ios::binary);
+  if (!in) {
+    throw std::runtime_error("cannot open " + input);
+  }
+  for (auto &l : readLODs(in)) {
+    write_mesh(prefix, l.ratio, format, l.verts, l.tris);
+  }
+}
 
 int main(int argc, char *argv[]) {
-  if (argc < 4) {
-    std::cerr
-      << "Usage: <executable> <input file> <output file prefix> <ratio[,ratio]*> <threshold>"
-      << std::endl;
-    exit(1);
+  auto start = std::chrono::steady_clock::now();
+  bool print_stats = false;
+  bool decoding = false;
+  bool reorder = false;
+  bool split_groups = false;
+  bool weighted = false;
+  real weld = -1; // off
+  size_t error_samples = 0; // off
+  bool compare = false;
+  int bits = 16;
+  MeshFormat format = MeshFormat::OBJ;
+  SimplifyOptions opts;
+  std::vector<char *> args;
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    if (arg == "--stats") {
+      print_stats = true;
+      STAT_SAMPLE_MEMORY();
+    } else if (arg == "--optimize-order") {
+      reorder = true;
+    } else if (arg == "--split-groups") {
+      split_groups = true;
+    } else if (arg == "--weighted") {
+      weighted = true;
+    } else if (arg == "--weld") {
+      if (++i == argc) {
+        usage();
+      }
+      weld = real_arg(argv[i]);
+    } else if (arg == "--error") {
+      if (error_samples == 0) {
+        error_samples = 100000;
+      }
+    } else if (arg == "--error-samples") {
+      if (++i == argc) {
+        usage();
+      }
+      error_samples = count_arg(argv[i]);
+    } else if (arg == "--queue") {
+      if (++i == argc) {
+        usage();
+      }
+      std::string q(argv[i]);
+      if (q == "heap") {
+        opts.queue = QueueKind::HEAP;
+      } else if (q == "bucket") {
+        opts.queue = QueueKind::BUCKET;
+      } else {
+        usage();
+      }
+    } else if (arg == "--huge-pages") {
+      allocPolicy().huge_pages = true;
+    } else if (arg == "--hugetlb") {
+      allocPolicy().hugetlb = true;
+    } else if (arg == "--numa-interleave") {
+      allocPolicy().interleave = true;
+    } else if (arg == "--compare-queues") {
+      compare = true;
+    } else if (arg == "--threads") {
+      if (++i == argc) {
+        usage();
+      }
+      threadCount() = count_arg(argv[i]);
+    } else if (arg == "--decode") {
+      decoding = true;
+    } else if (arg == "--budget") {
+      if (++i == argc) {
+        usage();
+      }
+      // the budget covers the whole run, reading included
+      opts.deadline = start + std::chrono::milliseconds(count_arg(argv[i]));
+    } else if (arg == "--format") {
+      if (++i == argc) {
+        usage();
+      }
+      try {
+        format = formatByName(argv[i]);
+      } catch (std::runtime_error &e) {
+        std::cerr << e.what() << std::endl;
+        usage();
+      }
+      if (format == MeshFormat::STL) {
+        std::cerr << "STL output is not supported" << std::endl;
+        exit(1);
+      }
+    } else if (arg == "--knn") {
+      if (++i == argc) {
+        usage();
+      }
+      opts.max_neighbors = count_arg(argv[i]);
+    } else if (arg == "--max-pairs") {
+      if (++i == argc) {
+        usage();
+      }
+      opts.pair_budget = count_arg(argv[i]);
+    } else if (arg == "--max-memory") {
+      if (++i == argc) {
+        usage();
+      }
+      opts.memory_budget = count_arg(argv[i]) << 20;
+    } else if (arg == "--bits") {
+      if (++i == argc) {
+        usage();
+      }
+      bits = std::min<size_t>(count_arg(argv[i]), 64);
+    } else {
+      args.push_back(argv[i]);
+    }
+  }
+
+  if (decoding) {
+    if (args.size() < 2 || format == MeshFormat::LOD) {
+      usage();
+    }
+    try {
+      decode(args[0], args[1], format);
+    } catch (std::runtime_error &e) {
+      std::cerr << args[0] << ": " << e.what() << std::endl;
+      exit(1);
+    }
+    return 0;
+  }
+
+  if (args.size() < 4) {
+    usage();
   }
-  std::ifstream in(argv[1]);
-  std::istringstream ratio_list(argv[3]);
-  std::istringstream threshold(argv[4]);
+  std::istringstream ratio_list(args[2]);
 
   std::vector<real> ratios;
   real ratio;
@@ -22,17 +478,109 @@ int main(int argc, char *argv[]) {
     ratio_list >> comma >> ratio;
     ratios.emplace_back(ratio);
   }
-  real thres;
-  threshold >> thres;
-  Mesh m(in);
-  m.simplify(
-             [&argv](Mesh &m, real ratio) {
-               std::ostringstream path;
-               path << argv[2] << '_' << ratio << ".obj";
-               std::ofstream out(path.str());
-               m.dump(out);
-               out.close();
-             },
-             ratios, thres);
-  in.close();
+  opts.epsilon = real_arg(args[3]);
+  std::string input = args[0];
+  std::string prefix = args[1];
+
+  if (split_groups) {
+    if (format != MeshFormat::OBJ || detectFormat(input) != MeshFormat::OBJ) {
+      std::cerr << "--split-groups needs OBJ input and output" << std::endl;
+      exit(1);
+    }
+    try {
+      simplify_groups(input, prefix, ratios, opts, weighted, reorder, weld,
+                      error_samples);
+    } catch (std::runtime_error &e) {
+      std::cerr << input << ": " << e.what() << std::endl;
+      exit(1);
+    }
+    if (print_stats) {
+      STAT_REPORT(std::cerr);
+    }
+    return 0;
+  }
+
+  Mesh m = [&input]() {
+    STAT_PHASE(phase, "read");
+    try {
+      return loadMesh(input);
+    } catch (std::runtime_error &e) {
+      std::cerr << input << ": " << e.what() << std::endl;
+      exit(1);
+    }
+  }();
+  if (weld >= 0) {
+    STAT_PHASE(phase, "weld");
+    size_t merged = m.weld(weld);
+    std::cerr << "welded " << merged << " duplicate vertices" << std::endl;
+  }
+
+  if (compare) {
+    compare_queues(m, ratios, opts, error_samples ? error_samples : 100000);
+    if (print_stats) {
+      STAT_REPORT(std::cerr);
+    }
+    return 0;
+  }
+
+  // all ratios go into one container
+  std::ofstream lod_out;
+  std::unique_ptr<LODWriter> lod;
+  if (format == MeshFormat::LOD) {
+    lod_out.open(prefix + ".lod", std::ios::binary);
+    try {
+      lod = std::make_unique<LODWriter>(lod_out, bits);
+    } catch (std::runtime_error &e) {
+      std::cerr << e.what() << std::endl;
+      exit(1);
+    }
+  }
+
+  std::unique_ptr<ErrorMeter> meter;
+  if (error_samples) {
+    STAT_PHASE(phase, "error/setup");
+    std::vector<Vector3f> verts;
+    std::vector<uint32_t> tris;
+    m.extract(verts, tris);
+    meter = std::make_unique<ErrorMeter>(std::move(verts), std::move(tris),
+                                         error_samples);
+  }
+
+  if (opts.memory_budget) {
+    std::cerr << "estimated memory without proximity pairs: "
+              << (m.memoryEstimate(0, opts.epsilon > 0) >> 20) << " MB of "
+              << (opts.memory_budget >> 20) << " MB" << std::endl;
+  }
+  try {
+    m.simplify(
+               [&prefix, format, &lod, reorder, &meter](Mesh &m, real ratio) {
+                 std::vector<Vector3f> verts;
+                 std::vector<uint32_t> tris;
+                 m.extract(verts, tris);
+                 report_error(meter.get(), ratio, verts, tris);
+                 if (reorder) {
+                   real before = acmr(tris, verts.size());
+                   reorder_for_gpu(verts, tris);
+                   std::cerr << "ratio " << ratio << ": ACMR " << before
+                             << " -> " << acmr(tris, verts.size()) << std::endl;
+                 }
+                 if (lod) {
+                   lod->add(ratio, verts, tris);
+                 } else {
+                   write_mesh(prefix, ratio, format, verts, tris);
+                 }
+               },
+               ratios, opts);
+  } catch (std::runtime_error &e) {
+    std::cerr << input << ": " << e.what() << std::endl;
+    exit(1);
+  }
+  if (lod) {
+    lod->finish();
+    lod_out.close();
+  }
+
+  if (print_stats) {
+    STAT_REPORT(std::cerr);
+  }
 }
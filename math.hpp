@@ -35,6 +35,9 @@ public:
   Vector3f operator+(const Vector3f &v) const {
     return Vector3f(x + v.x, y + v.y, z + v.z);
   }
+  Vector3f operator*(real d) const {
+    return Vector3f(x * d, y * d, z * d);
+  }
   Vector3f operator/(real d) const {
     return Vector3f(x / d, y / d, z / d);
   }
@@ -90,6 +93,7 @@ public:
     q22(q.q22), q23(q.q23), q24(q.q24),
     q33(q.q33), q34(q.q34),
     q44(q.q44) {}
+  Quadric4f &operator=(const Quadric4f &q) = default;
 
   Quadric4f &operator+=(const Quadric4f &q) {
     q11 += q.q11; q12 += q.q12; q13 += q.q13; q14 += q.q14;
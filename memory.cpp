@@ -0,0 +1,27 @@
+#include "memory.hpp"
+#include <fstream>
+#include <sstream>
+#include <string>
+
+static size_t status_field(const char *key) {
+  std::ifstream in("/proc/self/status");
+  std::string line;
+  size_t n = std::char_traits<char>::length(key);
+  while (std::getline(in, line)) {
+    if (line.compare(0, n, key) == 0) {
+      std::istringstream ls(line.substr(n));
+      size_t kb = 0;
+      ls >> kb;
+      return kb * 1024;
+    }
+  }
+  return 0;
+}
+
+size_t currentRSS() {
+  return status_field("VmRSS:");
+}
+
+size_t peakRSS() {
+  return status_field("VmHWM:");
+}
@@ -0,0 +1,13 @@
+#ifndef MEMORY_HPP
+#define MEMORY_HPP
+
+#include <cstddef>
+
+// Process memory as seen by the kernel, in bytes; 0 where unavailable.
+// Linux only.
+
+size_t currentRSS();
+// high-water mark since the process started
+size_t peakRSS();
+
+#endif
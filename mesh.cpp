@@ -1,13 +1,23 @@
 #include "mesh.hpp"
 #include "kd.hpp"
 #include "heap.hpp"
+#include "bucket.hpp"
+#include "stats.hpp"
+#include "io.hpp"
+#include "weld.hpp"
 #include <cassert>
+#include <sstream>
 #include <string>
-#include <iomanip>
 #include <utility>
 #include <algorithm>
 #include <set>
-#include <map>
+#include <array>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+#include <cmath>
+#include <limits>
 
 static void remember_pair(Point *a, Point *b,
                           std::set<std::pair<Point *, Point *>> &done) {
@@ -27,7 +37,7 @@ static bool ask_pair(Point *a, Point *b,
   }
 }
 
-Point &Point::merge(Point *p, const Vector3f &pos, Heap &pairs) {
+Point &Point::merge(Point *p, const Vector3f &pos, PairQueue &pairs) {
   x = pos.x;
   y = pos.y;
   z = pos.z;
@@ -42,6 +52,7 @@ Point &Point::merge(Point *p, const Vector3f &pos, Heap &pairs) {
       pr->updateVertex(p, this, pairs);
       if (pr->valid) {
         if (ask_pair(pr->p1, pr->p2, changed)) {
+          STAT_INC(duplicate_pairs);
           pr->valid = false;
         } else {
           remember_pair(pr->p1, pr->p2, changed);
@@ -52,9 +63,8 @@ Point &Point::merge(Point *p, const Vector3f &pos, Heap &pairs) {
   return *this;
 }
 
-Face::Face(Point *p1, Point *p2, Point *p3)
-  : p1(p1), p2(p2), p3(p3) {
-  Vector3f &&norm = cross(*p2 - *p1, *p3 - *p1);
+void Mesh::addFaceQuadric(Point &p1, Point &p2, Point &p3) {
+  Vector3f &&norm = cross(p2 - p1, p3 - p1);
   norm.normalize();
   // check nan if the face is degenerate
   if (!std::isnormal(norm.x) || !std::isnormal(norm.y) || !std::isnormal(norm.z)) {
@@ -64,14 +74,14 @@ Face::Face(Point *p1, Point *p2, Point *p3)
     a = norm.x,
     b = norm.y,
     c = norm.z,
-    d = -dot(*p1, norm);
+    d = -dot(p1, norm);
   Quadric4f Kp = Quadric4f(a*a, a*b, a*c, a*d,
                                 b*b, b*c, b*d,
                                      c*c, c*d,
                                           d*d);
-  p1->Q += Kp;
-  p2->Q += Kp;
-  p3->Q += Kp;
+  p1.Q += Kp;
+  p2.Q += Kp;
+  p3.Q += Kp;
 }
 
 static void compute_optimal(const Vector3f &v1, const Vector3f &v2, const Quadric4f &Q,
@@ -90,6 +100,7 @@ static void compute_optimal(const Vector3f &v1, const Vector3f &v2, const Quadri
     return;
   }
 
+  STAT_INC(singular);
   Vector3f mid = (v1 + v2) / 2;
   real
     error_1 = Q.apply(v1),
@@ -114,14 +125,29 @@ static void compute_optimal(const Vector3f &v1, const Vector3f &v2, const Quadri
   }
 }
 
+// A locked endpoint pins the result to itself; two locked endpoints never
+// collapse, and their pair sinks to the bottom of the queue.
+void Pair::evaluate() {
+  if (p1->locked && p2->locked) {
+    opt = *p1;
+    error = std::numeric_limits<real>::max();
+  } else if (p1->locked || p2->locked) {
+    opt = p1->locked ? *p1 : *p2;
+    error = (p1->Q + p2->Q).apply(opt);
+  } else {
+    compute_optimal(*p1, *p2, p1->Q + p2->Q, opt, error);
+  }
+}
+
 Pair::Pair(Point *x, Point *y)
   : p1(x), p2(y), valid(true) {
   x->ps.emplace_back(this);
   y->ps.emplace_back(this);
-  compute_optimal(*x, *y, x->Q + y->Q, opt, error);
+  evaluate();
 }
 
-void Pair::updateVertex(Point *x, Point *y, Heap &ps) {
+void Pair::updateVertex(Point *x, Point *y, PairQueue &ps) {
+  STAT_INC(update_vertex);
   if (p1 == x) {
     p1 = y;
   }
@@ -129,7 +155,7 @@ void Pair::updateVertex(Point *x, Point *y, Heap &ps) {
     p2 = y;
   }
   if (p1 != p2) {
-    compute_optimal(*p1, *p2, p1->Q + p2->Q, opt, error);
+    evaluate();
     ps.update(this);
   } else {
     valid = false;
@@ -139,6 +165,9 @@ void Pair::updateVertex(Point *x, Point *y, Heap &ps) {
 
 static void add_pair(Point *a, Point *b,
                      std::set<std::pair<Point *, Point *>> &selected) {
+  if (a == b) {
+    return; // a repeated index; collapsing it would make a point its own parent
+  }
   if (a > b) {
     std::swap(a, b);
   }
@@ -147,110 +176,425 @@ static void add_pair(Point *a, Point *b,
   }
 }
 
+// how many collapses pass between two looks at the clock in anytime mode
+static const size_t CLOCK_GRANULARITY = 1024;
+// at most this many vertices pass between two projections of the final
+// pair count
+static const size_t PROJECTION_GRANULARITY = 4096;
+// bisection steps on the grid size when clustering
+static const int CLUSTER_STEPS = 10;
+
+// What one pair costs at the peak of initialization: its node in the
+// selected set, its slot in the arena, a pointer in pre_heap and in the
+// queue, and a list node in each endpoint. Nodes are counted at their
+// typical malloc size.
+static const size_t PAIR_BYTES =
+  64 + sizeof(Pair) + 2 * sizeof(Pair *) + 2 * 32;
+// The KD tree per vertex: a leaf, an inner node, their two shared_ptr
+// control blocks and a slot in the array it is built from.
+static const size_t KD_POINT_BYTES = 32 + 64 + 2 * 32 + sizeof(Point *);
+// compact's scratch per face: the sorted key, the order and the keep bit
+static const size_t COMPACT_FACE_BYTES =
+  sizeof(std::array<uint32_t, 3>) + sizeof(uint32_t) + 1;
+
+// distinct vertex pairs along face edges, as the edge phase selects them
+size_t Mesh::countEdges() const {
+  std::vector<uint64_t> edges;
+  edges.reserve(faces.size());
+  for (size_t i = 0; i < faces.size(); i += 3) {
+    for (size_t j = 0; j < 3; j++) {
+      uint64_t a = faces[i + j], b = faces[i + (j + 1) % 3];
+      if (a != b) {
+        edges.push_back(std::min(a, b) << 32 | std::max(a, b));
+      }
+    }
+  }
+  std::sort(edges.begin(), edges.end());
+  return std::unique(edges.begin(), edges.end()) - edges.begin();
+}
+
+static size_t memory_for(size_t n_points, size_t n_faces, size_t n_pairs,
+                         bool kd_tree) {
+  return n_points * (sizeof(Point) + (kd_tree ? KD_POINT_BYTES : 0)) +
+    n_faces * (3 * sizeof(uint32_t) + COMPACT_FACE_BYTES) +
+    n_pairs * PAIR_BYTES;
+}
+
+size_t Mesh::memoryEstimate(size_t extra_pairs, bool kd_tree) const {
+  return memory_for(points.size(), faces.size() / 3,
+                    countEdges() + extra_pairs, kd_tree);
+}
+
 Mesh &Mesh::simplify(std::function<void (Mesh &, real ratio)> k,
-                     std::vector<real> percentage, real epsilon) {
-  std::cerr << "initializing ..." << std::endl;
+                     std::vector<real> percentage, const SimplifyOptions &opts) {
+  using clock = std::chrono::steady_clock;
+  if (opts.verbose) {
+    std::cerr << "initializing ..." << std::endl;
+  }
+
+  real epsilon = opts.epsilon;
+  // Fit the proximity pairs into what the memory budget leaves over once
+  // the edge pairs and, for the search, the KD tree are paid for.
+  size_t budget = opts.pair_budget;
+  if (opts.memory_budget) {
+    size_t n_edges = countEdges();
+    size_t base = memory_for(points.size(), faces.size() / 3, n_edges, false);
+    if (base > opts.memory_budget) {
+      throw std::runtime_error(
+        "memory budget of " + std::to_string(opts.memory_budget >> 20) +
+        " MB is below the " + std::to_string(base >> 20) +
+        " MB needed for the edge pairs alone");
+    }
+    size_t with_kd =
+      memory_for(points.size(), faces.size() / 3, n_edges, epsilon > 0);
+    size_t extra = opts.memory_budget > with_kd ?
+      (opts.memory_budget - with_kd) / PAIR_BYTES : 0;
+    if (epsilon > 0 && extra == 0) {
+      std::cerr << "warning: memory budget leaves no room for proximity "
+                << "pairs, simplifying along edges only" << std::endl;
+      epsilon = 0;
+    }
+    if (!budget || n_edges + extra < budget) {
+      budget = n_edges + extra;
+    }
+  }
+  auto start = clock::now();
+  auto past = [](std::optional<clock::time_point> t) {
+    return t && clock::now() >= *t;
+  };
+
+  if (opts.lock_boundary) {
+    lockBoundary();
+  }
 
-  // add edges
+  // add face quadrics and edges
   std::set<std::pair<Point *, Point *>> selected;
-  for (auto &f : faces) {
-    add_pair(f.p1, f.p2, selected);
-    add_pair(f.p2, f.p3, selected);
-    add_pair(f.p3, f.p1, selected);
+  STAT_BYTES("points", points.capacity() * sizeof(Point));
+  STAT_BYTES("faces", faces.capacity() * sizeof(uint32_t));
+  {
+    STAT_PHASE(phase, "init/edges");
+    for (size_t i = 0; i < faces.size(); i += 3) {
+      Point
+        *p1 = &points[faces[i]],
+        *p2 = &points[faces[i + 1]],
+        *p3 = &points[faces[i + 2]];
+      addFaceQuadric(*p1, *p2, *p3);
+      add_pair(p1, p2, selected);
+      add_pair(p2, p3, selected);
+      add_pair(p3, p1, selected);
+    }
+  }
+  // edge pairs are required, so they may already be over budget
+  if (budget && selected.size() >= budget) {
+    std::cerr << "warning: the " << selected.size() << " edge pairs alone "
+              << (selected.size() > budget ? "exceed" : "reach")
+              << " the pair budget of " << budget
+              << ", no proximity pairs are added" << std::endl;
+    epsilon = 0;
   }
 
-  // add close vertices
+  // Add close vertices. These pairs only refine the result, so in anytime
+  // mode the search gives up once half of the budget is gone, leaving the
+  // rest to the collapse loop.
   if (epsilon > 0) {
+    STAT_PHASE(phase, "init/proximity");
     std::vector<Point *> pts;
     for (auto &p : points) {
       pts.push_back(&p);
     }
 
     KDTree kdt = buildKDTree(pts);
+    STAT_BYTES("kd tree pointers", pts.capacity() * sizeof(Point *));
     pts.clear();
 
+    std::optional<clock::time_point> half;
+    if (opts.deadline) {
+      half = start + (*opts.deadline - start) / 2;
+    }
+    size_t n_edges = selected.size();
+    bool warned = false;
+    // small meshes still get a few projections before the search ends
+    size_t projection_step = std::clamp<size_t>(points.size() / 16, 1,
+                                                PROJECTION_GRANULARITY);
+    // Neighbours are filtered against the edges only: a proximity pair
+    // another vertex already added is still one of this vertex's k nearest,
+    // and add_pair drops the repeat.
+    std::vector<std::pair<Point *, Point *>> edges;
+    if (opts.max_neighbors) {
+      edges.assign(selected.begin(), selected.end()); // sorted, as the set
+    }
+    auto is_new = [&edges](Point *a, Point *b) {
+      if (a > b) {
+        std::swap(a, b);
+      }
+      return a != b && !std::binary_search(edges.begin(), edges.end(),
+                                            std::make_pair(a, b));
+    };
+    size_t i = 0;
     for (auto &p : points) {
-      kdt.radiusSearch(p, epsilon, pts);
+      if (++i % CLOCK_GRANULARITY == 0 && past(half)) {
+        std::cerr << "time budget: proximity search stopped after "
+                  << i << " of " << points.size() << " vertices" << std::endl;
+        break;
+      }
+      if (budget && !warned && i % projection_step == 0) {
+        size_t projected =
+          n_edges + (selected.size() - n_edges) * points.size() / i;
+        if (projected > budget) {
+          std::cerr << "warning: projected pair count " << projected
+                    << " exceeds the budget of " << budget << std::endl;
+          warned = true;
+        }
+      }
+      if (opts.max_neighbors) {
+        kdt.knnSearch(p, opts.max_neighbors, epsilon,
+                      [&p, &is_new](Point *q) { return is_new(&p, q); }, pts);
+      } else {
+        kdt.radiusSearch(p, epsilon, pts);
+      }
+      bool full = false;
       for (auto &q : pts) {
         if (&p != q) {
           add_pair(&p, q, selected);
+          // one vertex in a dense cluster may bring the whole cluster
+          if (budget && selected.size() >= budget) {
+            full = true;
+            break;
+          }
         }
       }
       pts.clear();
+      if (full) {
+        std::cerr << "warning: pair budget of " << budget
+                  << " reached, proximity search stopped after "
+                  << i << " of " << points.size() << " vertices" << std::endl;
+        break;
+      }
+    }
+    if (opts.verbose) {
+      std::cerr << "proximity pairs: " << selected.size() - n_edges
+                << " (edges: " << n_edges << ")" << std::endl;
     }
   }
 
+  // once past the deadline, the pairs would never be collapsed
+  bool out_of_time = past(opts.deadline);
+
+  // all pairs in one array, which never grows past its reservation
+  std::vector<Pair, BigAllocator<Pair>> arena;
   std::vector<Pair *> pre_heap;
-  for (auto &pp : selected) {
-    pre_heap.push_back(new Pair(pp.first, pp.second));
+  if (!out_of_time) {
+    STAT_PHASE(phase, "init/pairs");
+    arena.reserve(selected.size());
+    for (auto &pp : selected) {
+      arena.emplace_back(pp.first, pp.second);
+      pre_heap.push_back(&arena.back());
+    }
+    STAT_BYTES("selected set", selected.size() * 64);
+    STAT_BYTES("pair arena", arena.capacity() * sizeof(Pair));
+    STAT_BYTES("pre_heap", pre_heap.capacity() * sizeof(Pair *));
+    STAT_BYTES("point pair lists", 2 * arena.size() * 32);
+  }
+  // the arena now holds every pair; the set is dead weight from here on
+  selected.clear();
+  std::unique_ptr<PairQueue> queue;
+  if (!out_of_time) {
+    STAT_PHASE(phase, "init/heap");
+    if (opts.queue == QueueKind::BUCKET) {
+      queue = std::make_unique<BucketQueue>(std::move(pre_heap));
+    } else {
+      queue = std::make_unique<Heap>(std::move(pre_heap));
+    }
+    STAT_BYTES("queue", arena.size() * sizeof(Pair *));
+  }
+  if (opts.verbose) {
+    std::cerr << "initialization end." << std::endl;
   }
-  Heap pairs(std::move(pre_heap));
-
-  std::cerr << "initialization end." << std::endl;
 
   std::sort(percentage.begin(), percentage.end());
-  std::vector<Pair *> removed;
-  size_t n_points = points.size(), n = n_points;
+  // locked vertices stay on top of every ratio, which counts the rest
+  size_t n_points = std::count_if(points.begin(), points.end(),
+                                  [](const Point &p) { return !p.locked; });
+  size_t n = n_points;
   do {
-    std::cerr << "next percentage: " << percentage.back() << std::endl;
-    while (n > percentage.back() * n_points) {
-      auto least = pairs.top();
-      if (least->valid) {
-        least->p1->merge(least->p2, least->opt, pairs);
-        n -= 1;
-      } else {
-        pairs.erase(least);
+    if (opts.verbose) {
+      std::cerr << "next percentage: " << percentage.back() << std::endl;
+    }
+    size_t target = percentage.back() * n_points;
+    // once clustered, the queue no longer matches the mesh
+    if (!out_of_time) {
+      STAT_PHASE(phase, "collapse " + std::to_string(percentage.back()));
+      size_t i = 0;
+      PairQueue &pairs = *queue;
+      while (n > target && !pairs.empty()) {
+        if (++i % CLOCK_GRANULARITY == 0 && past(opts.deadline)) {
+          out_of_time = true;
+          break;
+        }
+        auto least = pairs.top();
+        if (least->valid && !(least->p1->locked && least->p2->locked)) {
+          STAT_INC(collapses);
+          // the locked end, if any, survives
+          if (least->p2->locked) {
+            least->p2->merge(least->p1, least->opt, pairs);
+          } else {
+            least->p1->merge(least->p2, least->opt, pairs);
+          }
+          n -= 1;
+        } else {
+          pairs.erase(least);
+        }
       }
-      removed.emplace_back(least);
     }
-    k(*this, percentage.back());
+    if (out_of_time && n > target) {
+      STAT_PHASE(phase, "cluster " + std::to_string(percentage.back()));
+      size_t before = n;
+      n = cluster(target);
+      // one write, as groups may report from several threads at once
+      std::ostringstream msg;
+      msg << "time budget exhausted at ratio " << real(before) / n_points
+          << ", clustered to " << real(n) / n_points
+          << " (target " << percentage.back() << ")\n";
+      std::cerr << msg.str() << std::flush;
+    }
+    {
+      STAT_PHASE(phase, "compact " + std::to_string(percentage.back()));
+      compact();
+    }
+    {
+      STAT_PHASE(phase, "output " + std::to_string(percentage.back()));
+      k(*this, percentage.back());
+    }
     percentage.pop_back();
   } while (!percentage.empty());
 
-  for  (auto &p : removed) {
-    delete p;
-  }
-
   return *this;
 }
 
-Mesh::Mesh(std::istream &is) {
-  std::string op;
-  std::string garbage;
-  while (is >> op) {
-    if (op == "v") {
-      real x, y, z;
-      is >> x >> y >> z;
-      points.emplace_back(x, y, z);
-    } else if (op == "f") {
-      std::vector<size_t> vs;
-      size_t v;
-      is >> v;
-      if (is.peek() == '/') {
-        char slash;
-        size_t vt;
-        is >> slash >> vt;
-        do {
-          vs.emplace_back(v);
-          is >> v >> slash >> vt;
-        } while (is.good());
-      } else {
-        do {
-          vs.emplace_back(v);
-          is >> v;
-        } while (is.good());
-      }
-      is.clear();
-      for (size_t i = 1; i < vs.size() - 1; i++) {
-        faces.emplace_front(&points[vs[0] - 1], &points[vs[i] - 1], &points[vs[i+1] - 1]);
+// Vertex clustering, the coarse stage of anytime mode: merges the live
+// vertices by the cells of a uniform grid, using the finest cell size that
+// leaves at most target of them, and moves each survivor to the mean of
+// its cell. Locked vertices are left out, and not counted in target or in
+// the result. Returns how many are left.
+size_t Mesh::cluster(size_t target) {
+  target = std::max<size_t>(target, 1);
+  std::vector<Point *> live;
+  Vector3f lo(0, 0, 0), hi(0, 0, 0);
+  for (auto &p : points) {
+    if (p.useful() && !p.locked) {
+      if (live.empty()) {
+        lo = hi = p;
       }
+      lo = Vector3f(std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z));
+      hi = Vector3f(std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z));
+      live.push_back(&p);
+    }
+  }
+  if (live.size() <= target) {
+    return live.size();
+  }
+
+  auto key = [&lo](const Point *p, real h) {
+    return WeldKey{weld_coord(p->x - lo.x, h), weld_coord(p->y - lo.y, h),
+                   weld_coord(p->z - lo.z, h)};
+  };
+  auto occupied = [&live, &key](real h) {
+    std::unordered_set<WeldKey, WeldKeyHash> cells;
+    for (auto p : live) {
+      cells.insert(key(p, h));
+    }
+    return cells.size();
+  };
+  // bisect the cell size geometrically between one cell holding the whole
+  // box and cells far finer than the target needs
+  real extent = std::max({hi.x - lo.x, hi.y - lo.y, hi.z - lo.z});
+  real coarse = extent > 0 ? 2 * extent : 1, fine = coarse / (1 << 20);
+  for (int it = 0; it < CLUSTER_STEPS; it++) {
+    real mid = std::sqrt(coarse * fine);
+    if (occupied(mid) <= target) {
+      coarse = mid;
     } else {
-      std::getline(is, garbage);
+      fine = mid;
+    }
+  }
+
+  struct Cell {
+    Point *rep;
+    Vector3f sum;
+    size_t count;
+  };
+  std::unordered_map<WeldKey, Cell, WeldKeyHash> cells;
+  for (auto p : live) {
+    auto it = cells.emplace(key(p, coarse), Cell{p, Vector3f(0, 0, 0), 0}).first;
+    Cell &c = it->second;
+    c.sum = c.sum + *p;
+    c.count += 1;
+    if (c.rep != p) {
+      c.rep->Q += p->Q;
+      p->fa = c.rep;
     }
   }
+  for (auto &kc : cells) {
+    Cell &c = kc.second;
+    Vector3f mean = c.sum / c.count;
+    c.rep->x = mean.x;
+    c.rep->y = mean.y;
+    c.rep->z = mean.z;
+  }
+  return cells.size();
 }
 
-static std::tuple<Point *, Point *, Point *> sort3(Point *a, Point *b, Point *c) {
+// Locks both ends of every edge that only one face uses.
+void Mesh::lockBoundary() {
+  std::vector<uint64_t> edges;
+  edges.reserve(faces.size());
+  for (size_t i = 0; i < faces.size(); i += 3) {
+    for (size_t j = 0; j < 3; j++) {
+      uint64_t a = faces[i + j], b = faces[i + (j + 1) % 3];
+      edges.push_back(std::min(a, b) << 32 | std::max(a, b));
+    }
+  }
+  std::sort(edges.begin(), edges.end());
+  for (size_t i = 0; i < edges.size();) {
+    size_t j = i;
+    while (j < edges.size() && edges[j] == edges[i]) {
+      j++;
+    }
+    if (j - i == 1) {
+      points[edges[i] >> 32].locked = true;
+      points[edges[i] & 0xffffffff].locked = true;
+    }
+    i = j;
+  }
+}
+
+Mesh::Mesh(std::istream &is) {
+  std::vector<Vector3f> verts;
+  readOBJ(is, verts, faces);
+  points.reserve(verts.size());
+  for (auto &v : verts) {
+    points.emplace_back(v.x, v.y, v.z);
+  }
+  compact(); // degenerate and duplicate faces, as welded STL is full of
+}
+
+Mesh::Mesh(const std::vector<Vector3f> &verts, std::vector<uint32_t> &&tris)
+  : faces(std::move(tris)) {
+  points.reserve(verts.size());
+  for (auto &v : verts) {
+    points.emplace_back(v.x, v.y, v.z);
+  }
+  compact(); // degenerate and duplicate faces, as welded STL is full of
+}
+
+size_t Mesh::weld(real tolerance) {
+  size_t before = points.size();
+  weldVertices(points, faces, tolerance);
+  compact();
+  return before - points.size();
+}
+
+static std::array<uint32_t, 3> sort3(uint32_t a, uint32_t b, uint32_t c) {
   if (c < b) {
     std::swap(c, b);
   }
@@ -263,33 +607,73 @@ static std::tuple<Point *, Point *, Point *> sort3(Point *a, Point *b, Point *c)
   return {a, b, c};
 }
 
-void Mesh::dump(std::ostream &os, int precision) {
-  os << std::setprecision(precision);
+// Redirect every face to the representatives of its vertices, then drop
+// collapsed faces and duplicates (keeping the first of each), so that each
+// later ratio only pays for the faces that survived the previous one.
+void Mesh::compact() {
+  size_t n_faces = faces.size() / 3;
+  std::vector<std::array<uint32_t, 3>> keys(n_faces);
+  std::vector<uint32_t> order;
+  for (size_t i = 0; i < n_faces; i++) {
+    for (size_t j = 0; j < 3; j++) {
+      uint32_t &v = faces[3 * i + j];
+      v = points[v].repr() - points.data();
+    }
+    uint32_t *f = &faces[3 * i];
+    if (f[0] != f[1] && f[1] != f[2] && f[2] != f[0]) {
+      keys[i] = sort3(f[0], f[1], f[2]);
+      order.push_back(i);
+    }
+  }
 
-  std::map<const Point *, size_t> number;
-  std::set<std::tuple<Point *, Point *, Point *>> face;
-  size_t n = 0;
-  for (auto &p : points) {
+  std::vector<bool> keep(n_faces, false);
+  std::stable_sort(order.begin(), order.end(),
+                   [&keys](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+  for (size_t i = 0; i < order.size(); i++) {
+    if (i == 0 || keys[order[i]] != keys[order[i - 1]]) {
+      keep[order[i]] = true;
+    }
+  }
+
+  size_t m = 0;
+  for (size_t i = 0; i < n_faces; i++) {
+    if (keep[i]) {
+      for (size_t j = 0; j < 3; j++) {
+        faces[3 * m + j] = faces[3 * i + j];
+      }
+      m += 1;
+    }
+  }
+  faces.resize(3 * m);
+  faces.shrink_to_fit();
+}
+
+void Mesh::extract(std::vector<Vector3f> &verts, std::vector<uint32_t> &tris) const {
+  std::vector<uint32_t> number(points.size());
+  verts.clear();
+  for (size_t i = 0; i < points.size(); i++) {
+    auto &p = points[i];
     if (p.useful()) {
-      n += 1;
-      number[&p] = n;
-      os << "v" << ' '
-         << p.x << ' '
-         << p.y << ' '
-         << p.z << '\n';
-    }
-  }
-  for (auto &f : faces) {
-    f.p1 = (f.p1)->repr();
-    f.p2 = (f.p2)->repr();
-    f.p3 = (f.p3)->repr();
-    auto sorted = sort3(f.p1, f.p2, f.p3);
-    if (f.p1 != f.p2 && f.p2 != f.p3 && f.p3 != f.p1 && !face.count(sorted)) {
-      face.insert(sorted);
-      os << "f" << ' '
-         << number[f.p1] << ' '
-         << number[f.p2] << ' '
-         << number[f.p3] << '\n';
+      number[i] = verts.size();
+      verts.emplace_back(p);
     }
   }
+  tris.resize(faces.size());
+  for (size_t i = 0; i < faces.size(); i++) {
+    tris[i] = number[faces[i]];
+  }
+}
+
+void Mesh::dump(std::ostream &os, int precision) {
+  std::vector<Vector3f> verts;
+  std::vector<uint32_t> tris;
+  extract(verts, tris);
+  writeOBJ(os, verts, tris, precision);
+}
+
+void Mesh::dumpPLY(std::ostream &os) {
+  std::vector<Vector3f> verts;
+  std::vector<uint32_t> tris;
+  extract(verts, tris);
+  writePLY(os, verts, tris);
 }
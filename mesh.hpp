@@ -2,72 +2,125 @@
 #define MESH_HPP
 
 #include "math.hpp"
+#include "alloc.hpp"
 #include <functional>
 #include <vector>
 #include <list>
 #include <iostream>
+#include <cstdint>
+#include <chrono>
+#include <optional>
 
-class Face;
 class Pair;
-class Heap;
+class PairQueue;
 
 class Point : public Vector3f {
-  friend class Face;
+  friend class Mesh;
   friend class Pair;
 private:
   Quadric4f Q;
   std::list<Pair *> ps;
   Point *fa;
+  bool locked; // never moves; see SimplifyOptions::lock_boundary
 public:
-  Point(real x, real y, real z) : Vector3f(x, y, z), fa(nullptr) {}
-  Point &merge(Point *p, const Vector3f &pos, Heap &pairs);
+  Point(real x, real y, real z) : Vector3f(x, y, z), fa(nullptr), locked(false) {}
+  Point &merge(Point *p, const Vector3f &pos, PairQueue &pairs);
   bool useful() const { return fa == nullptr; }
   Point *repr() {
-    if (fa == nullptr) {
-      return this;
-    } else {
-      fa = fa->repr();
-      return fa;
+    Point *r = this;
+    while (r->fa != nullptr) {
+      r = r->fa;
+    }
+    // path compression
+    for (Point *p = this; p != r;) {
+      Point *next = p->fa;
+      p->fa = r;
+      p = next;
     }
+    return r;
   }
 };
 
-class Face {
-  friend class Mesh;
-private:
-  Point *p1;
-  Point *p2;
-  Point *p3;
-public:
-  Face(Point *p1, Point *p2, Point *p3);
-};
-
 class Pair {
   friend class Point;
   friend class Mesh;
   friend class Heap;
+  friend class BucketQueue;
 private:
-  size_t id; // index in the heap
+  size_t id; // index in the heap, or in its bucket
+  size_t slot; // bucket in a BucketQueue
   Point *p1;
   Point *p2;
   Vector3f opt;
   real error;
+
+  void evaluate();
 public:
   bool valid;
   Pair(Point *p1, Point *p2);
-  void updateVertex(Point *x, Point *y, Heap &ps);
+  void updateVertex(Point *x, Point *y, PairQueue &ps);
   bool degenerate() const { return p1 == p2; }
 };
 
+enum class QueueKind {
+  HEAP,   // exact binary heap
+  BUCKET  // approximate bucket queue, see bucket.hpp
+};
+
+struct SimplifyOptions {
+  real epsilon = 0; // also pair up vertices closer than this
+  // with epsilon, pair each vertex only with its this many nearest
+  // non-edge neighbours (0: all of them)
+  size_t max_neighbors = 0;
+  // total pairs allowed; beyond it no more proximity pairs are added
+  // (0: unlimited)
+  size_t pair_budget = 0;
+  // bytes the simplification may use (0: unlimited); proximity pairs are
+  // cut to fit, and simplify throws if even the edge pairs do not fit
+  size_t memory_budget = 0;
+  // Anytime mode: once the deadline passes, collapsing stops and every
+  // ratio not yet reached is finished by vertex clustering, a coarse pass
+  // of about ten hashing sweeps over the vertices.
+  std::optional<std::chrono::steady_clock::time_point> deadline;
+  QueueKind queue = QueueKind::HEAP;
+  // keep vertices on open boundaries where they are, so that parts
+  // simplified apart still meet at their seams
+  bool lock_boundary = false;
+  bool verbose = true; // progress messages; warnings are always printed
+};
+
 class Mesh {
 private:
-  std::vector<Point> points;
-  std::list<Face> faces;
+  std::vector<Point, BigAllocator<Point>> points;
+  std::vector<uint32_t> faces; // three indices into points per triangle
+
+  static void addFaceQuadric(Point &p1, Point &p2, Point &p3);
+  size_t countEdges() const;
+  size_t cluster(size_t target);
+  void lockBoundary();
+  void compact();
 public:
-  Mesh(std::istream &is);
+  Mesh(std::istream &is); // text OBJ
+  Mesh(const std::vector<Vector3f> &verts, std::vector<uint32_t> &&tris);
+  // Merges coincident vertices (see weld.hpp) and drops the faces this
+  // degenerates; call before simplify. Returns how many vertices went away.
+  size_t weld(real tolerance = 0);
+  // the surviving vertices, and the faces renumbered to match
+  void extract(std::vector<Vector3f> &verts, std::vector<uint32_t> &tris) const;
   void dump(std::ostream &os, int precision = 8);
+  void dumpPLY(std::ostream &os);
+  // Bytes simplify needs at its peak for the edge pairs, counted exactly,
+  // plus extra_pairs proximity pairs and, with kd_tree, the search tree.
+  // Node-based containers are taken at their typical malloc sizes.
+  size_t memoryEstimate(size_t extra_pairs = 0, bool kd_tree = false) const;
   Mesh &simplify(std::function<void (Mesh &, real ratio)> k,
-                 std::vector<real> percentage, real epsilon = 0);
+                 std::vector<real> percentage, const SimplifyOptions &opts);
+  Mesh &simplify(std::function<void (Mesh &, real ratio)> k,
+                 std::vector<real> percentage, real epsilon = 0) {
+    SimplifyOptions opts;
+    opts.epsilon = epsilon;
+    return simplify(k, std::move(percentage), opts);
+  }
 };
 
 #endif
@@ -0,0 +1,158 @@
+#include "order.hpp"
+#include <algorithm>
+#include <cmath>
+
+static const size_t CACHE_SIZE = 32;
+
+// https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
+static real vertex_score(int cache_pos, uint32_t remaining) {
+  if (remaining == 0) {
+    return -1;
+  }
+  real score = 0;
+  if (cache_pos >= 0) {
+    if (cache_pos < 3) {
+      // the last triangle's vertices score the same to avoid favouring
+      // strips in one direction
+      score = 0.75;
+    } else {
+      real scaler = 1.0 / (CACHE_SIZE - 3);
+      score = std::pow(1.0 - (cache_pos - 3) * scaler, 1.5);
+    }
+  }
+  // boost vertices with few triangles left to get rid of lone ones
+  return score + 2.0 / std::sqrt(static_cast<real>(remaining));
+}
+
+void optimizeVertexCache(std::vector<uint32_t> &tris, size_t n_verts) {
+  size_t n_tris = tris.size() / 3;
+  if (n_tris == 0) {
+    return;
+  }
+
+  // vertex to triangle adjacency, compressed
+  std::vector<uint32_t> offset(n_verts + 1, 0);
+  for (auto v : tris) {
+    offset[v + 1] += 1;
+  }
+  for (size_t i = 0; i < n_verts; i++) {
+    offset[i + 1] += offset[i];
+  }
+  std::vector<uint32_t> adj(tris.size());
+  std::vector<uint32_t> fill(offset.begin(), offset.end() - 1);
+  for (size_t i = 0; i < tris.size(); i++) {
+    adj[fill[tris[i]]++] = i / 3;
+  }
+
+  // remaining[v]: triangles of v not yet emitted, kept at the front of v's
+  // adjacency range
+  std::vector<uint32_t> remaining(n_verts);
+  std::vector<int> cache_pos(n_verts, -1);
+  std::vector<real> vscore(n_verts);
+  for (size_t v = 0; v < n_verts; v++) {
+    remaining[v] = offset[v + 1] - offset[v];
+    vscore[v] = vertex_score(-1, remaining[v]);
+  }
+  std::vector<real> tscore(n_tris);
+  std::vector<bool> emitted(n_tris, false);
+  for (size_t t = 0; t < n_tris; t++) {
+    tscore[t] = vscore[tris[3 * t]] + vscore[tris[3 * t + 1]] + vscore[tris[3 * t + 2]];
+  }
+
+  std::vector<uint32_t> out;
+  out.reserve(tris.size());
+  std::vector<uint32_t> cache, next_cache;
+  size_t cursor = 0; // for restarting when the cache has no candidates
+  long best = -1;
+  while (out.size() < tris.size()) {
+    if (best < 0) {
+      while (emitted[cursor]) {
+        cursor += 1;
+      }
+      best = cursor;
+    }
+
+    emitted[best] = true;
+    const uint32_t *tri = &tris[3 * best];
+    next_cache.assign(tri, tri + 3);
+    for (int j = 0; j < 3; j++) {
+      uint32_t v = tri[j];
+      out.push_back(v);
+      // drop best from v's live triangles
+      uint32_t *b = &adj[offset[v]], *e = b + remaining[v];
+      std::swap(*std::find(b, e, best), *(e - 1));
+      remaining[v] -= 1;
+    }
+    for (auto v : cache) {
+      if (v != tri[0] && v != tri[1] && v != tri[2]) {
+        next_cache.push_back(v);
+      }
+    }
+    for (size_t i = CACHE_SIZE; i < next_cache.size(); i++) {
+      cache_pos[next_cache[i]] = -1; // evicted
+    }
+    next_cache.resize(std::min(next_cache.size(), CACHE_SIZE));
+
+    // rescore the touched vertices, including the evicted ones
+    for (auto v : cache) {
+      if (cache_pos[v] < 0) {
+        vscore[v] = vertex_score(-1, remaining[v]);
+        for (uint32_t i = offset[v]; i < offset[v] + remaining[v]; i++) {
+          uint32_t t = adj[i];
+          tscore[t] = vscore[tris[3 * t]] + vscore[tris[3 * t + 1]] + vscore[tris[3 * t + 2]];
+        }
+      }
+    }
+    for (size_t i = 0; i < next_cache.size(); i++) {
+      cache_pos[next_cache[i]] = i;
+    }
+    for (auto v : next_cache) {
+      vscore[v] = vertex_score(cache_pos[v], remaining[v]);
+    }
+    best = -1;
+    real best_score = -1;
+    for (auto v : next_cache) {
+      for (uint32_t i = offset[v]; i < offset[v] + remaining[v]; i++) {
+        uint32_t t = adj[i];
+        tscore[t] = vscore[tris[3 * t]] + vscore[tris[3 * t + 1]] + vscore[tris[3 * t + 2]];
+        if (tscore[t] > best_score) {
+          best_score = tscore[t];
+          best = t;
+        }
+      }
+    }
+    std::swap(cache, next_cache);
+  }
+  tris.swap(out);
+}
+
+void optimizeVertexFetch(std::vector<Vector3f> &verts, std::vector<uint32_t> &tris) {
+  const uint32_t unused = ~0u;
+  std::vector<uint32_t> number(verts.size(), unused);
+  std::vector<Vector3f> out;
+  out.reserve(verts.size());
+  for (auto &v : tris) {
+    if (number[v] == unused) {
+      number[v] = out.size();
+      out.push_back(verts[v]);
+    }
+    v = number[v];
+  }
+  verts.swap(out);
+}
+
+real acmr(const std::vector<uint32_t> &tris, size_t n_verts, size_t cache_size) {
+  if (tris.empty()) {
+    return 0;
+  }
+  // stamp[v]: value of the miss counter when v entered the cache
+  std::vector<size_t> stamp(n_verts, 0);
+  size_t misses = 0;
+  for (auto v : tris) {
+    if (stamp[v] == 0 || misses - stamp[v] >= cache_size) {
+      misses += 1;
+      stamp[v] = misses;
+    }
+  }
+  return static_cast<real>(misses) / (tris.size() / 3);
+}
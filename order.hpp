@@ -0,0 +1,22 @@
+#ifndef ORDER_HPP
+#define ORDER_HPP
+
+#include "math.hpp"
+#include <cstdint>
+#include <vector>
+
+// Post-processing of an output LOD for the GPU: triangle order for the
+// post-transform vertex cache, vertex order for fetch locality.
+
+// Forsyth's linear-speed vertex cache optimisation, modelled on a 32 entry
+// LRU cache.
+void optimizeVertexCache(std::vector<uint32_t> &tris, size_t n_verts);
+
+// Renumber vertices in order of first use; unreferenced vertices are dropped.
+void optimizeVertexFetch(std::vector<Vector3f> &verts, std::vector<uint32_t> &tris);
+
+// Average cache miss ratio (transformed vertices per triangle) of a FIFO
+// cache with the given number of entries.
+real acmr(const std::vector<uint32_t> &tris, size_t n_verts, size_t cache_size = 16);
+
+#endif
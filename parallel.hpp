@@ -0,0 +1,67 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include "stats.hpp"
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// number of workers used by parallelFor; 0 picks the hardware concurrency
+inline size_t &threadCount() {
+  static size_t n = 0;
+  return n;
+}
+
+inline size_t workers() {
+  size_t n = threadCount();
+  if (n == 0) {
+    n = std::max(1u, std::thread::hardware_concurrency());
+  }
+  return n;
+}
+
+// set on pool threads, so that nested loops run inline instead of
+// starting a pool of their own
+inline bool &inWorker() {
+  static thread_local bool w = false;
+  return w;
+}
+
+// Calls f(i) for every i < n on a pool of worker threads, handing out
+// indices in order, one at a time. Called from a worker, it runs inline.
+inline void parallelFor(size_t n, const std::function<void (size_t)> &f) {
+  size_t m = std::min(workers(), n);
+  if (m <= 1 || inWorker()) {
+    for (size_t i = 0; i < n; i++) {
+      f(i);
+    }
+    return;
+  }
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> pool;
+  for (size_t t = 0; t < m; t++) {
+    pool.emplace_back([&next, n, &f]() {
+      inWorker() = true;
+      for (size_t i; (i = next.fetch_add(1)) < n;) {
+        f(i);
+      }
+      STAT_FLUSH();
+    });
+  }
+  for (auto &t : pool) {
+    t.join();
+  }
+}
+
+// Splits [0, n) into one contiguous chunk per worker and calls
+// f(begin, end) on each.
+inline void parallelChunks(size_t n, const std::function<void (size_t, size_t)> &f) {
+  size_t m = std::max<size_t>(1, std::min(workers(), n));
+  parallelFor(m, [n, m, &f](size_t t) {
+    f(n * t / m, n * (t + 1) / m);
+  });
+}
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef QUEUE_HPP
+#define QUEUE_HPP
+
+#include "mesh.hpp"
+
+// What Mesh::simplify needs from its priority queue of pairs. The pairs
+// themselves live in an array owned by the caller.
+class PairQueue {
+public:
+  virtual void erase(Pair *p) = 0;
+  virtual void insert(Pair *p) = 0;
+  virtual bool empty() const = 0;
+  // a pair of (near) least error
+  virtual Pair *top() = 0;
+  // p's error has changed
+  virtual void update(Pair *p) = 0;
+  virtual ~PairQueue() = default;
+};
+
+#endif
@@ -0,0 +1,111 @@
+#include "stats.hpp"
+#include <functional>
+#include <iomanip>
+
+#ifdef SIMP_STATS
+Stats stats;
+thread_local StatCounters stat_counters = {};
+#endif
+
+void Stats::addPhase(const std::string &name, const std::string &parent,
+                     double seconds, size_t peak_rss, size_t rss_growth) {
+  std::lock_guard<std::mutex> g(lock);
+  for (auto &ph : phases) {
+    if (ph.name == name) {
+      ph.seconds += seconds;
+      ph.peak_rss = std::max(ph.peak_rss, peak_rss);
+      ph.rss_growth = std::max(ph.rss_growth, rss_growth);
+      return;
+    }
+  }
+  phases.push_back({name, parent, seconds, peak_rss, rss_growth});
+}
+
+void Stats::addStructure(const std::string &name, size_t bytes) {
+  std::lock_guard<std::mutex> g(lock);
+  for (auto &st : structures) {
+    if (st.first == name) {
+      st.second = std::max(st.second, bytes);
+      return;
+    }
+  }
+  structures.emplace_back(name, bytes);
+}
+
+void Stats::merge(StatCounters &c) {
+  std::lock_guard<std::mutex> g(lock);
+  total.heap_up += c.heap_up;
+  total.heap_down += c.heap_down;
+  total.bucket_scan += c.bucket_scan;
+  total.update_vertex += c.update_vertex;
+  total.duplicate_pairs += c.duplicate_pairs;
+  total.singular += c.singular;
+  total.kd_visited += c.kd_visited;
+  total.peak_pairs = std::max(total.peak_pairs, c.peak_pairs);
+  total.collapses += c.collapses;
+  c = {};
+}
+
+void Stats::report(std::ostream &os) {
+  std::lock_guard<std::mutex> g(lock);
+  double seconds = 0;
+  for (auto &ph : phases) {
+    if (ph.parent.empty()) {
+      seconds += ph.seconds;
+    }
+  }
+  const double MB = 1 << 20;
+
+  os << std::fixed << std::setprecision(6);
+  os << "phases:\n";
+  // nested phases follow their parent, indented and without a share
+  std::function<void (const std::string &, int)> print =
+    [&](const std::string &parent, int depth) {
+      for (auto &ph : phases) {
+        if (ph.parent != parent || ph.name == parent) {
+          continue;
+        }
+        std::string label(2 * depth, ' ');
+        label += ph.name;
+        os << "  " << std::left << std::setw(24) << label
+           << std::right << std::setw(12) << ph.seconds << " s"
+           << std::setprecision(1);
+        if (depth == 0) {
+          os << std::setw(8)
+             << (seconds > 0 ? 100 * ph.seconds / seconds : 0) << " %";
+        } else {
+          os << std::setw(10) << "";
+        }
+        if (sample_memory) {
+          os << std::setw(10) << ph.peak_rss / MB << " MB peak RSS (+"
+             << ph.rss_growth / MB << ")";
+        }
+        os << '\n' << std::setprecision(6);
+        print(ph.name, depth + 1);
+      }
+    };
+  print("", 0);
+  os << "  " << std::left << std::setw(24) << "total"
+     << std::right << std::setw(12) << seconds << " s\n";
+
+  auto counter = [&os](const char *name, size_t v) {
+    os << "  " << std::left << std::setw(24) << name
+       << std::right << std::setw(12) << v << '\n';
+  };
+  os << "counters:\n";
+  counter("collapses", total.collapses);
+  counter("heap_up_steps", total.heap_up);
+  counter("heap_down_steps", total.heap_down);
+  counter("bucket_scan_steps", total.bucket_scan);
+  counter("update_vertex", total.update_vertex);
+  counter("duplicate_pairs", total.duplicate_pairs);
+  counter("singular_fallbacks", total.singular);
+  counter("kd_nodes_visited", total.kd_visited);
+  counter("peak_pairs", total.peak_pairs);
+  os << "structures (estimated peak):\n" << std::setprecision(1);
+  for (auto &st : structures) {
+    os << "  " << std::left << std::setw(24) << st.first
+       << std::right << std::setw(12) << st.second / MB << " MB\n";
+  }
+  os << std::defaultfloat << std::flush;
+}
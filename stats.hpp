@@ -0,0 +1,115 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include "memory.hpp"
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+// Hot-path counters, phase timers and memory accounting. Everything is
+// compiled out unless SIMP_STATS is defined. Counters are per thread and
+// folded into the global record by STAT_FLUSH; phases with the same name
+// add up, so with several threads their times are summed CPU seconds.
+// When memory sampling is switched on (STAT_SAMPLE_MEMORY), each phase also
+// records the process' RSS high-water mark when it ended and how far the
+// phase raised it. The mark is never reset, so nested and concurrent phases
+// do not disturb each other. A phase opened inside another on the same
+// thread is reported under it and left out of the total.
+
+struct StatCounters {
+  size_t heap_up;         // sift-up steps in the heap
+  size_t heap_down;       // sift-down steps in the heap
+  size_t bucket_scan;     // empty buckets skipped in the bucket queue
+  size_t update_vertex;   // Pair::updateVertex calls
+  size_t duplicate_pairs; // pairs invalidated as duplicates in merge
+  size_t singular;        // compute_optimal fallbacks
+  size_t kd_visited;      // KD-tree nodes visited
+  size_t peak_pairs;      // of the largest single heap
+  size_t collapses;
+};
+
+struct StatPhaseRecord {
+  std::string name;
+  std::string parent; // empty for a top-level phase
+  double seconds;
+  size_t peak_rss;   // high-water mark at the end of the phase
+  size_t rss_growth; // by how much the phase raised it
+};
+
+struct Stats {
+  StatCounters total = {};
+  std::vector<StatPhaseRecord> phases;
+  std::vector<std::pair<std::string, size_t>> structures; // name, peak bytes
+  std::mutex lock;
+  bool sample_memory = false; // reads /proc twice per phase
+
+  void addPhase(const std::string &name, const std::string &parent,
+                double seconds, size_t peak_rss, size_t rss_growth);
+  void addStructure(const std::string &name, size_t bytes);
+  void merge(StatCounters &c); // and reset c
+  void report(std::ostream &os);
+};
+
+#ifdef SIMP_STATS
+
+extern Stats stats;
+extern thread_local StatCounters stat_counters;
+
+class StatPhase {
+  std::string name;
+  StatPhase *outer;
+  std::chrono::steady_clock::time_point start;
+  size_t peak_before;
+
+  static StatPhase *&current() {
+    static thread_local StatPhase *p = nullptr;
+    return p;
+  }
+public:
+  StatPhase(std::string name)
+    : name(std::move(name)), outer(current()),
+      start(std::chrono::steady_clock::now()),
+      peak_before(stats.sample_memory ? peakRSS() : 0) {
+    current() = this;
+  }
+  ~StatPhase() {
+    std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+    size_t peak = stats.sample_memory ? peakRSS() : 0;
+    stats.addPhase(name, outer ? outer->name : std::string(), d.count(), peak,
+                   peak - std::min(peak, peak_before));
+    current() = outer;
+  }
+};
+
+#define STAT_INC(c) (stat_counters.c += 1)
+#define STAT_MAX(c, v) \
+  (stat_counters.c = std::max(stat_counters.c, static_cast<size_t>(v)))
+// times the rest of the enclosing scope
+#define STAT_PHASE(var, name) StatPhase var(name)
+// estimated bytes held by a data structure; the largest value is kept
+#define STAT_BYTES(name, bytes) stats.addStructure(name, bytes)
+// have later phases record RSS; call before the first one
+#define STAT_SAMPLE_MEMORY() (stats.sample_memory = true)
+// call before a worker thread ends
+#define STAT_FLUSH() stats.merge(stat_counters)
+#define STAT_REPORT(os) (STAT_FLUSH(), stats.report(os))
+
+#else
+
+#define STAT_INC(c) ((void)0)
+#define STAT_MAX(c, v) ((void)0)
+#define STAT_PHASE(var, name) ((void)0)
+#define STAT_BYTES(name, bytes) ((void)0)
+#define STAT_SAMPLE_MEMORY() ((void)0)
+#define STAT_FLUSH() ((void)0)
+#define STAT_REPORT(os) \
+  ((os) << "statistics are not compiled in (configure with -DSIMP_STATS=ON)" \
+        << std::endl)
+
+#endif
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef WELD_HPP
+#define WELD_HPP
+
+#include "math.hpp"
+#include "parallel.hpp"
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// Vertex welding by hashing quantized positions. With tolerance 0 only
+// bit-identical positions (0.0 and -0.0 alike) are merged; otherwise
+// positions are snapped to a grid of that spacing, so two vertices closer
+// than the tolerance may still land in neighbouring cells and stay apart.
+
+typedef std::array<int64_t, 3> WeldKey;
+
+struct WeldKeyHash {
+  size_t operator()(const WeldKey &k) const {
+    uint64_t h = k[0];
+    h = h * 0x9e3779b97f4a7c15ull ^ k[1];
+    h = h * 0x9e3779b97f4a7c15ull ^ k[2];
+    return h ^ (h >> 29);
+  }
+};
+
+inline int64_t weld_coord(real c, real tolerance) {
+  if (tolerance > 0) {
+    return static_cast<int64_t>(std::floor(c / tolerance));
+  }
+  if (c == 0) {
+    c = 0; // -0.0
+  }
+  int64_t bits;
+  std::memcpy(&bits, &c, sizeof(bits));
+  return bits;
+}
+
+// below this many vertices welding runs on the calling thread
+static const size_t WELD_PARALLEL_MIN = 1 << 16;
+
+// Maps every vertex to the first vertex sharing its key. Keys are computed
+// in parallel; grouping is split into shards by hash, one per worker, and
+// each shard only visits its own vertices.
+template <typename Vec>
+std::vector<uint32_t> weldMap(const Vec &verts, real tolerance) {
+  size_t n = verts.size();
+  size_t shards = n < WELD_PARALLEL_MIN ? 1 : workers();
+  std::vector<WeldKey> keys(n);
+  std::vector<size_t> hashes(n);
+  auto hash_range = [&](size_t b, size_t e) {
+    for (size_t i = b; i < e; i++) {
+      keys[i] = {weld_coord(verts[i].x, tolerance),
+                 weld_coord(verts[i].y, tolerance),
+                 weld_coord(verts[i].z, tolerance)};
+      hashes[i] = WeldKeyHash()(keys[i]);
+    }
+  };
+  if (shards > 1) {
+    parallelChunks(n, hash_range);
+  } else {
+    hash_range(0, n);
+  }
+
+  // vertex indices bucketed by shard, ascending within each
+  std::vector<uint32_t> start(shards + 1, 0), members(n);
+  for (size_t i = 0; i < n; i++) {
+    start[hashes[i] % shards + 1] += 1;
+  }
+  for (size_t s = 0; s < shards; s++) {
+    start[s + 1] += start[s];
+  }
+  std::vector<uint32_t> fill(start.begin(), start.end() - 1);
+  for (size_t i = 0; i < n; i++) {
+    members[fill[hashes[i] % shards]++] = i;
+  }
+
+  std::vector<uint32_t> rep(n);
+  parallelFor(shards, [&](size_t s) {
+    std::unordered_map<WeldKey, uint32_t, WeldKeyHash> first;
+    first.reserve(start[s + 1] - start[s]);
+    for (size_t j = start[s]; j < start[s + 1]; j++) {
+      uint32_t i = members[j];
+      rep[i] = first.emplace(keys[i], i).first->second;
+    }
+  });
+  return rep;
+}
+
+// Applies weldMap: keeps the representatives in their original order and
+// renumbers tris. Faces may become degenerate or duplicated.
+template <typename Vec>
+void weldVertices(Vec &verts, std::vector<uint32_t> &tris, real tolerance) {
+  std::vector<uint32_t> rep = weldMap(verts, tolerance);
+  std::vector<uint32_t> number(verts.size());
+  size_t m = 0;
+  for (size_t i = 0; i < verts.size(); i++) {
+    if (rep[i] == i) {
+      number[i] = m;
+      if (m != i) {
+        verts[m] = verts[i];
+      }
+      m += 1;
+    } else {
+      number[i] = number[rep[i]];
+    }
+  }
+  verts.erase(verts.begin() + m, verts.end());
+  auto renumber = [&](size_t b, size_t e) {
+    for (size_t i = b; i < e; i++) {
+      tris[i] = number[tris[i]];
+    }
+  };
+  if (tris.size() < WELD_PARALLEL_MIN) {
+    renumber(0, tris.size());
+  } else {
+    parallelChunks(tris.size(), renumber);
+  }
+}
+
+#endif